@@ -3,6 +3,13 @@
 
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <algorithm>
+#include <unordered_map>
+
+static mc::cvar<uint32_t>
+	chunk_uploads(8, "render/chunk_uploads",
+		      "The maximum number of chunk meshes uploaded per frame");
+
 class mineclone_application : public mc::application {
     public:
 	mineclone_application()
@@ -15,63 +22,51 @@ class mineclone_application : public mc::application {
 
 	virtual void init() override
 	{
-		std::unique_ptr<mc::world::chunk_draw_data_generator> chunk_gen =
-			std::make_unique<
-				mc::world::simple_chunk_draw_data_generator>();
+		m_world = std::make_unique<mc::world::world_state>();
 
-		mc::world::chunk chunk;
+		m_mesher = std::make_unique<mc::world::meshing_service>(
+			get_executor(),
+			std::make_unique<
+				mc::world::greedy_chunk_draw_data_generator>());
 
-		for (int i = 1; i <= 63; i++) {
-			for (int j = 1; j <= 63; j++) {
-				for (int k = 1; k <= 63; k++) {
-					int dx = (i - 32) * (i - 32);
-					int dy = (j - 32) * (j - 32);
-					int dz = (k - 32) * (k - 32);
+		const int center = CHUNK_SIZE / 2;
+		const int radius = CHUNK_SIZE * 23 / 64;
 
-					if (dx + dy + dz <= 23 * 23) {
-						chunk.set(
-							i, j, k,
-							mc::world::blocks::dirt);
-					}
+		const int dim = 8;
+		const int height = 6;
+		for (int x = 0; x < dim; x++) {
+			for (int y = 0; y < height; y++) {
+				for (int z = 0; z < dim; z++) {
+					mc::world::chunk *chunk =
+						m_world->load_chunk(
+							glm::ivec3(x, y, z));
+
+					fill_sphere(chunk, center, radius);
 				}
 			}
 		}
 
-		mc::world::chunk_draw_data draw_data =
-			chunk_gen->generate(&chunk);
-
-		LOG_INFO(Default, "Real face count: {}",
-			 draw_data.faces.size());
+		std::shared_ptr<mc::world::world_snapshot> snapshot =
+			m_world->snapshot();
 
 		mc::render::world_renderer *world_renderer =
 			get_render_thread()->get_world_renderer();
 
-		const int dim = 8;
-		const int height = 6;
-		mc::render::chunk_handle chunks[dim][height][dim];
-		for (int i = 0; i < dim; i++) {
-			for (int j = 0; j < height; j++) {
-				for (int k = 0; k < dim; k++) {
-					chunks[i][j][k] =
-						world_renderer->alloc_chunk();
-				}
-			}
-		}
-
-		for (int i = 0; i < dim; i++) {
-			for (int j = 0; j < height; j++) {
-				for (int k = 0; k < dim; k++) {
-					glm::mat4 model = glm::translate(
-						glm::mat4(1.0f),
-						glm::vec3(i * CHUNK_SIZE,
-							  j * CHUNK_SIZE,
-							  k * CHUNK_SIZE));
-
-					world_renderer->upload_chunk(
-						chunks[i][j][k], &draw_data,
-						model);
-				}
-			}
+		// Meshed by the renderer a few at a time when it can, otherwise
+		// in the background and uploaded as they complete
+		if (world_renderer->meshes_voxels()) {
+			m_voxels = snapshot;
+			snapshot->for_each_chunk(
+				[&](const glm::ivec3 &coords,
+				    const mc::world::chunk *chunk) {
+					m_unmeshed.push_back(coords);
+				});
+		} else {
+			snapshot->for_each_chunk(
+				[&](const glm::ivec3 &coords,
+				    const mc::world::chunk *chunk) {
+					m_mesher->request(snapshot, coords);
+				});
 		}
 
 		get_window()->set_cursor(mc::cursor_mode::hidden);
@@ -140,14 +135,44 @@ class mineclone_application : public mc::application {
 		state.render.view = glm::inverse(m_camera.get_matrix());
 		state.render.projection = projection;
 
+		m_mesher->set_view(state.render.view);
+		m_world->reclaim();
+		m_world->update_cold_tier();
+
 		float time = state.input.get_delta_time();
 		m_fps = (time != 0.0f ? 1.0f / time : 0.0f);
 	}
 
 	virtual void render() override
 	{
+		upload_meshes();
+
 		if (ImGui::Begin("Stats")) {
 			ImGui::Text("FPS: %.2f", m_fps);
+			ImGui::Text("Chunks queued: %zu",
+				    m_mesher->get_queued());
+
+			mc::world::cold_tier_stats cold =
+				mc::world::get_cold_tier_stats();
+
+			double ratio = 0.0;
+			if (cold.compressed_bytes != 0) {
+				ratio = static_cast<double>(cold.raw_bytes) /
+					cold.compressed_bytes;
+			}
+
+			double mean_us = 0.0;
+			if (cold.decompressed != 0) {
+				mean_us = cold.decompress_ns * 1e-3 /
+					  cold.decompressed;
+			}
+
+			ImGui::Text("Cold chunks: %llu, ratio %.2f",
+				    static_cast<unsigned long long>(
+					    cold.compressed),
+				    ratio);
+			ImGui::Text("Thaw: %.1f us mean, %.1f us max", mean_us,
+				    cold.decompress_max_ns * 1e-3);
 			ImGui::End();
 		}
 	}
@@ -157,6 +182,94 @@ class mineclone_application : public mc::application {
 	}
 
     private:
+	static void fill_sphere(mc::world::chunk *chunk, int center, int radius)
+	{
+		const mc::world::block_id dirt = mc::world::blocks::dirt;
+
+		for (int i = CHUNK_BEGIN; i < CHUNK_END; i++) {
+			for (int j = CHUNK_BEGIN; j < CHUNK_END; j++) {
+				for (int k = CHUNK_BEGIN; k < CHUNK_END; k++) {
+					int dx = (i - center) * (i - center);
+					int dy = (j - center) * (j - center);
+					int dz = (k - center) * (k - center);
+
+					if (dx + dy + dz <= radius * radius) {
+						chunk->set(i, j, k, dirt);
+					}
+				}
+			}
+		}
+	}
+
+	// Called on the render thread
+	void upload_meshes()
+	{
+		mc::render::world_renderer *world_renderer =
+			get_render_thread()->get_world_renderer();
+
+		m_meshes.clear();
+		m_mesher->collect(m_meshes, chunk_uploads.get());
+
+		for (mc::world::meshing_service::result &res : m_meshes) {
+			world_renderer->upload_chunk(get_handle(res.coords),
+						     res.hash, res.mesh.get(),
+						     get_model(res.coords));
+		}
+
+		size_t count = std::min<size_t>(m_unmeshed.size(),
+						chunk_uploads.get());
+		for (size_t i = 0; i < count; i++) {
+			glm::ivec3 coords = m_unmeshed.back();
+			m_unmeshed.pop_back();
+
+			const mc::world::chunk *chunk =
+				m_voxels->get_chunk(coords);
+
+			world_renderer->upload_voxels(get_handle(coords),
+						      chunk->content_hash(),
+						      chunk, get_model(coords));
+		}
+
+		if (m_unmeshed.empty()) {
+			m_voxels.reset();
+		}
+	}
+
+	mc::render::chunk_handle get_handle(const glm::ivec3 &coords)
+	{
+		uint64_t key = mc::world::pack_coords(coords);
+
+		auto it = m_handles.find(key);
+		if (it == m_handles.end()) {
+			mc::render::world_renderer *world_renderer =
+				get_render_thread()->get_world_renderer();
+
+			mc::render::chunk_handle handle =
+				world_renderer->alloc_chunk();
+			it = m_handles.emplace(key, handle).first;
+		}
+
+		return it->second;
+	}
+
+	static glm::mat4 get_model(const glm::ivec3 &coords)
+	{
+		return glm::translate(glm::mat4(1.0f),
+				      glm::vec3(coords * CHUNK_SIZE));
+	}
+
+    private:
+	// Declared before the mesher, which must be destroyed first
+	std::unique_ptr<mc::world::world_state> m_world;
+	std::unique_ptr<mc::world::meshing_service> m_mesher;
+
+	std::vector<mc::world::meshing_service::result> m_meshes;
+
+	// Chunks left for the renderer to mesh, read through m_voxels
+	std::shared_ptr<mc::world::world_snapshot> m_voxels;
+	std::vector<glm::ivec3> m_unmeshed;
+	std::unordered_map<uint64_t, mc::render::chunk_handle> m_handles;
+
 	mc::transform m_camera;
 	float m_sensitivity = 0.005f;
 	float m_speed = 5.0f;
@@ -3,50 +3,74 @@
 layout(location = 0) out vec3 outUVW;
 layout(location = 1) out float outAO;
 
-struct Face {
-  uint geometry;
-  uint shading;
+// Faces of the page being drawn. Those of a wide mesh are a geometry and a
+// shading word. Compact meshes have only the geometry word, with an index into
+// the mesh's texture table above it instead of the shading word.
+layout(binding = 1, std430) readonly buffer faces_ssbo {
+  uint words[];
 };
 
-struct Chunk {
-  mat4 model;
-  uint normal;
+// Chunks drawing the same mesh are instances of one draw, six draws per mesh
+layout(binding = 2, std430) readonly buffer instances_ssbo {
+  mat4 models[];
 };
 
-layout(binding = 1, std430) readonly buffer faces_ssbo {
-  Face faces[];
+#define COMPACT_TEXTURES 64
+
+struct MeshInfo {
+  uint wide;
+  uint textures[COMPACT_TEXTURES / 2];
 };
 
-layout(binding = 2, std430) readonly buffer chunks_ssbo {
-  Chunk chunks[];
+// By mesh in draw order, each of which has six draws
+layout(binding = 3, std430) readonly buffer meshes_ssbo {
+  MeshInfo meshes[];
 };
 
+// Faces are drawn a page at a time, starting with this mesh
+uniform uint u_first_mesh;
+
 uniform mat4 u_view;
 uniform mat4 u_projection;
 
+// Injected by the renderer to match the engine's chunk size
+#ifndef CHUNK_SIZE_LOG
+#define CHUNK_SIZE_LOG 6
+#endif
+
 uint extract_x(uint geometry)
 {
-  return geometry & ((1 << 6) - 1);
+  return geometry & ((1 << CHUNK_SIZE_LOG) - 1);
 }
 
 uint extract_y(uint geometry)
 {
-  return (geometry >> 6) & ((1 << 6) - 1);
+  return (geometry >> CHUNK_SIZE_LOG) & ((1 << CHUNK_SIZE_LOG) - 1);
 }
 
 uint extract_z(uint geometry)
 {
-  return (geometry >> 12) & ((1 << 6) - 1);
+  return (geometry >> (2 * CHUNK_SIZE_LOG)) & ((1 << CHUNK_SIZE_LOG) - 1);
 }
 
 uint extract_ao(uint geometry)
 {
-  return (geometry >> 18) & ((1 << 8) - 1);
+  return (geometry >> (3 * CHUNK_SIZE_LOG)) & ((1 << 8) - 1);
 }
 
 uint extract_tex(uint shading)
 {
-  return shading;
+  return shading & ((1 << 16) - 1);
+}
+
+uint extract_w(uint shading)
+{
+  return ((shading >> 16) & ((1 << CHUNK_SIZE_LOG) - 1)) + 1;
+}
+
+uint extract_h(uint shading)
+{
+  return ((shading >> (16 + CHUNK_SIZE_LOG)) & ((1 << CHUNK_SIZE_LOG) - 1)) + 1;
 }
 
 const int dx[] = { 1, 0, 0, 0, 0, 0 };
@@ -67,50 +91,60 @@ const int dtopv[] = { 0, 1, 1, 0, 1, 0 };
 
 void main()
 {
-  Face face = faces[gl_VertexID / 6];
-  uint x = extract_x(face.geometry);
-  uint y = extract_y(face.geometry);
-  uint z = extract_z(face.geometry);
-  uint ao = extract_ao(face.geometry);
+  uint mesh = u_first_mesh + uint(gl_DrawID) / 6;
+  // Each face is drawn as four vertices, indexed as two triangles
+  uint id = uint(gl_VertexID) >> 2;
+  uint corner = uint(gl_VertexID) & 3;
+
+  uint geometry;
+  uint shading;
+  if (meshes[mesh].wide != 0) {
+    geometry = words[id * 2];
+    shading = words[id * 2 + 1];
+  } else {
+    uint shift = 3 * CHUNK_SIZE_LOG + 8;
+    uint texture = words[id] >> shift;
+
+    geometry = words[id] & ((1u << shift) - 1);
+    shading = (meshes[mesh].textures[texture / 2] >> (texture % 2 * 16)) &
+              0xffff;
+  }
+
+  uint x = extract_x(geometry);
+  uint y = extract_y(geometry);
+  uint z = extract_z(geometry);
+  uint ao = extract_ao(geometry);
 
   uint u = 0;
   uint v = 0;
-  uint tex = extract_tex(face.shading);
-
-  mat4 model = chunks[gl_DrawID].model;
-  uint normal = chunks[gl_DrawID].normal;
+  uint tex = extract_tex(shading);
+  uint w = extract_w(shading);
+  uint h = extract_h(shading);
 
-  uint idx = gl_VertexID % 6;
+  mat4 model = models[gl_BaseInstance + gl_InstanceID];
+  uint normal = uint(gl_DrawID) % 6;
 
   x += dx[normal];
   y += dy[normal];
   z += dz[normal];
 
-  if (1 <= idx && idx <= 3) {
-    x += dleftx[normal];
-    y += dlefty[normal];
-    z += dleftz[normal];
-    u += dleftu[normal];
-    v += dleftv[normal];
-  }
-
-  if (2 <= idx && idx <= 4) {
-    x += dtopx[normal];
-    y += dtopy[normal];
-    z += dtopz[normal];
-    u += dtopu[normal];
-    v += dtopv[normal];
+  if (corner == 1 || corner == 2) {
+    x += dleftx[normal] * w;
+    y += dlefty[normal] * w;
+    z += dleftz[normal] * w;
+    u += dleftu[normal] * w;
+    v += dleftv[normal] * w;
   }
 
-  if (idx == 1) {
-    ao >>= 2;
-  } else if (idx == 2 || idx == 3) {
-    ao >>= 4;
-  } else if (idx == 4) {
-    ao >>= 6;
+  if (corner >= 2) {
+    x += dtopx[normal] * h;
+    y += dtopy[normal] * h;
+    z += dtopz[normal] * h;
+    u += dtopu[normal] * h;
+    v += dtopv[normal] * h;
   }
 
-  ao &= 3;
+  ao = (ao >> (corner * 2)) & 3;
 
   outUVW = vec3(float(u), float(v), float(tex));
   outAO = float(ao) / 4.0;
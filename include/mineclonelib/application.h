@@ -12,6 +12,11 @@
 
 #include <memory>
 
+namespace tf
+{
+class Executor;
+}
+
 namespace mc
 {
 struct application_frame {};
@@ -63,6 +68,13 @@ class application {
 		return m_render_thread.get();
 	}
 
+	// Runs the frame pipeline; background work may be queued on it too.
+	// Created before init() and destroyed with the application.
+	inline tf::Executor *get_executor() const
+	{
+		return m_executor.get();
+	}
+
 	static inline application *get() noexcept
 	{
 		return s_instance;
@@ -76,6 +88,8 @@ class application {
 
 	std::unique_ptr<render_thread> m_render_thread;
 
+	std::unique_ptr<tf::Executor> m_executor;
+
 	application_state m_state;
 	std::vector<application_frame> m_frames;
 };
@@ -9,6 +9,8 @@
 
 #include "mineclonelib/world/blocks.h"
 #include "mineclonelib/world/chunk.h"
+#include "mineclonelib/world/world.h"
+#include "mineclonelib/world/meshing.h"
 
 #include "mineclonelib/io/assets.h"
 #include "mineclonelib/io/keys.h"
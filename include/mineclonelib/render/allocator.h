@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// First and second level bins of a range_allocator: sizes below 8 have a bin
+// each, larger ones share a bin with the sizes of the same top four bits
+#define RANGE_BIN_TOP 32
+#define RANGE_BIN_SUB 8
+#define RANGE_BIN_COUNT (RANGE_BIN_TOP * RANGE_BIN_SUB)
+
+namespace mc
+{
+namespace render
+{
+// Two-level segregated fit allocator of ranges within a space of units, such
+// as faces in a GPU buffer. It only does the bookkeeping, so the space can be
+// anything the caller indexes by offset. allocate() and free() are O(1), and
+// free ranges are merged with their neighbours when freed.
+class range_allocator {
+    public:
+	// 1-based, 0 is never a valid range
+	using handle = uint32_t;
+
+	range_allocator();
+
+	range_allocator(const range_allocator &) = delete;
+	range_allocator &operator=(const range_allocator &) = delete;
+
+	// Returns a range of size units, or 0 if no free range is large
+	// enough. size must not be 0.
+	handle allocate(uint32_t size);
+	void free(handle h);
+
+	// Adds size units at the end of the space
+	void grow(uint32_t size);
+
+	// The used range with the highest offset, or 0 if there is none
+	handle get_last() const;
+
+	inline uint32_t get_offset(handle h) const
+	{
+		return m_nodes[h - 1].offset;
+	}
+
+	inline uint32_t get_size(handle h) const
+	{
+		return m_nodes[h - 1].size;
+	}
+
+	inline uint32_t get_space() const
+	{
+		return m_space;
+	}
+
+	inline uint32_t get_used() const
+	{
+		return m_used;
+	}
+
+    private:
+	struct node {
+		uint32_t offset;
+		uint32_t size;
+
+		// Neighbours in the space and, while free, in the bin
+		handle prev;
+		handle next;
+		handle bin_prev;
+		handle bin_next;
+
+		bool used;
+	};
+
+	// Bin of the largest size class at most size, or with round_up of the
+	// smallest size class whose sizes are all at least size
+	static uint32_t get_bin(uint32_t size, bool round_up) noexcept;
+
+	handle new_node(uint32_t offset, uint32_t size);
+	void delete_node(handle h);
+
+	void insert_free(handle h);
+	void remove_free(handle h);
+
+	// The first non-empty bin from bin up, or RANGE_BIN_COUNT if none
+	uint32_t find_bin(uint32_t bin) const noexcept;
+
+    private:
+	std::vector<node> m_nodes;
+	std::vector<handle> m_free_nodes;
+
+	handle m_bins[RANGE_BIN_COUNT];
+	uint32_t m_top_mask;
+	uint8_t m_sub_masks[RANGE_BIN_TOP];
+
+	// Last range of the space, used or free
+	handle m_tail;
+
+	uint32_t m_space;
+	uint32_t m_used;
+};
+}
+}
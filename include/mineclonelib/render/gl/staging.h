@@ -0,0 +1,77 @@
+#pragma once
+
+#include <glad/gl.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace mc
+{
+namespace render
+{
+namespace gl
+{
+// A persistently mapped ring that buffer updates are written into, then copied
+// to their buffers in one batch by flush(). Each batch is fenced, and its part
+// of the ring is only written again once the fence signals, so updates only
+// wait on the GPU when the ring is full.
+//
+// Staged copies are issued by flush() alone, which must come before anything
+// else reads or writes the ranges they target.
+class staging_ring {
+    public:
+	// size is rounded up to a multiple of 16 bytes
+	staging_ring(size_t size);
+	~staging_ring();
+
+	staging_ring(const staging_ring &) = delete;
+	staging_ring &operator=(const staging_ring &) = delete;
+
+	// Returns size bytes of the ring, 16-byte aligned, to be copied to
+	// offset in buffer by the next flush(), or nullptr if size is larger
+	// than the ring
+	void *stage(GLuint buffer, size_t offset, size_t size);
+
+	// Stages a copy of data, or writes it straight to buffer if it is
+	// larger than the ring
+	void write(GLuint buffer, size_t offset, size_t size, const void *data);
+
+	// Issues the copies staged since the last flush and fences them
+	void flush();
+
+    private:
+	struct copy {
+		GLuint buffer;
+		size_t src;
+		size_t dst;
+		size_t size;
+	};
+
+	// The ring up to end, as counted by m_head, is read by copies issued
+	// before fence
+	struct batch {
+		uint64_t end;
+		GLsync fence;
+	};
+
+	// Releases the ring of the oldest batch if its copies are done within
+	// timeout nanoseconds, and returns whether they were
+	bool retire(GLuint64 timeout);
+
+    private:
+	GLuint m_buffer;
+	uint8_t *m_data;
+	size_t m_size;
+
+	// Bytes ever staged and ever released, the ring holding those between
+	uint64_t m_head;
+	uint64_t m_tail;
+
+	std::vector<copy> m_copies;
+	std::deque<batch> m_batches;
+};
+}
+}
+}
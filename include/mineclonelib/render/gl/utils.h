@@ -8,7 +8,10 @@ namespace render
 {
 namespace gl
 {
-GLuint load_shader(const char *path, GLenum type);
+// Loads and compiles a shader. defines, if given, is inserted right after
+// the #version line.
+GLuint load_shader(const char *path, GLenum type,
+		   const char *defines = nullptr);
 bool check_compile_status(GLuint shader, const char *file = nullptr);
 bool check_link_status(GLuint program);
 }
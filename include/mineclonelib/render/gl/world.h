@@ -1,15 +1,27 @@
 #pragma once
 
+#include "mineclonelib/render/allocator.h"
+#include "mineclonelib/render/gl/staging.h"
 #include "mineclonelib/render/world.h"
 
 #include <glad/gl.h>
 
+#include <memory>
 #include <stack>
+#include <unordered_map>
+#include <vector>
 
 namespace mc
 {
 namespace render
 {
+namespace gl
+{
+// Creates the buffers of the block and AO tables chunk_mesh.comp reads, from
+// the registered blocks
+void create_mesh_tables(GLuint &blocks, GLuint &ao);
+}
+
 class gl_world_renderer : public world_renderer {
     public:
 	gl_world_renderer(context *ctx);
@@ -18,22 +30,204 @@ class gl_world_renderer : public world_renderer {
 	virtual chunk_handle alloc_chunk() override;
 	virtual void free_chunk(chunk_handle handle) override;
 
-	virtual void upload_chunk(chunk_handle handle,
-				  mc::world::chunk_draw_data *draw_data,
+	virtual void upload_chunk(chunk_handle handle, uint64_t hash,
+				  const mc::world::chunk_mesh *mesh,
 				  const glm::mat4 &model) override;
 
+	virtual void patch_chunk(chunk_handle handle, uint64_t hash,
+				 const mc::world::chunk_mesh *mesh,
+				 uint8_t normals) override;
+
+	virtual bool meshes_voxels() const override;
+	virtual void upload_voxels(chunk_handle handle, uint64_t hash,
+				   const mc::world::chunk *ch,
+				   const glm::mat4 &model) override;
+
 	virtual void render(const glm::mat4 &view,
 			    const glm::mat4 &projection) override;
 
     private:
+	struct indirect_draw_command {
+		unsigned int count;
+		unsigned int instance_count;
+		unsigned int first_index;
+		int base_vertex;
+		unsigned int base_instance;
+	};
+
+	// How chunk.vert decodes the faces of a mesh
+	struct mesh_info {
+		uint32_t wide;
+
+		// The texture table of a compact mesh, two face ids a word
+		uint32_t textures[COMPACT_TEXTURES / 2];
+	};
+
+	// A slot holding one mesh, which is drawn once for each chunk using
+	// it. The faces of each normal have a range of a page of their own,
+	// with a few spare faces so patches can usually be written in place.
+	// Meshes that fit are stored in the compact face format, where offsets
+	// and capacities count 4-byte faces instead of packed_faces.
+	struct mesh_slot {
+		// Identify the mesh; see chunk_mesh::content
+		uint64_t hash;
+		std::vector<uint8_t> content;
+
+		uint32_t counts[6];
+		uint32_t offsets[6];
+		uint32_t capacity[6];
+		range_allocator::handle ranges[6];
+		uint32_t page;
+		uint32_t base_instance;
+
+		// Position of the mesh's six commands in m_indirect and of its
+		// info in m_mesh_info, as of the last update_instances()
+		uint32_t draw;
+
+		bool wide;
+		mesh_info info;
+		std::vector<chunk_handle> chunks;
+	};
+
+	// A fixed-size buffer of faces that meshes take ranges from. The
+	// ranges of a mesh are all in one page, so the meshes of a page are
+	// drawn together with the page bound.
+	struct face_page {
+		GLuint buffer;
+		range_allocator faces;
+
+		// Slot and normal by range, as (slot << 3) | normal
+		std::vector<uint32_t> owners;
+
+		// The meshes of the page in m_indirect
+		uint32_t first_draw;
+		uint32_t draws;
+	};
+
+	struct chunk_slot {
+		// Mesh slot plus one, 0 while the chunk has nothing to draw
+		uint32_t mesh;
+		glm::mat4 model;
+	};
+
+	// A mesh slot filled by the meshing shader, whose face counts are
+	// read back once its fence signals
+	struct gpu_mesh {
+		uint32_t mesh;
+		GLsync fence;
+	};
+
+	uint32_t find_or_upload_mesh(uint64_t hash,
+				     const mc::world::chunk_mesh *mesh);
+
+	// Whether slot idx holds the mesh of chunks with this content hash and
+	// content. Empty content matches nothing.
+	bool holds(uint32_t idx, uint64_t hash,
+		   const std::vector<uint8_t> &content) const;
+
+	// The cached slot holding that mesh, or 0
+	uint32_t find_mesh(uint64_t hash,
+			   const std::vector<uint8_t> &content) const;
+
+	// Adds slot idx to, or removes it from, the mesh cache. Only the first
+	// of meshes with colliding hashes is cached.
+	void cache_mesh(uint32_t idx);
+	void uncache_mesh(uint32_t idx);
+	uint32_t alloc_mesh();
+	void attach_chunk(chunk_handle handle, uint32_t mesh);
+	void detach_chunk(chunk_handle handle);
+
+	void create_quad_indices();
+	void create_mesh_program();
+
+	// Reads back the counts of gpu_mesh m if they are ready within timeout
+	// nanoseconds, and returns whether they were. A failed wait is logged
+	// and leaves the mesh pending.
+	bool read_gpu_counts(const gpu_mesh &m, GLuint64 timeout);
+
+	// Stops tracking the meshing of slot mesh, if it is pending, after
+	// waiting for its counts if wait is set
+	void forget_gpu_mesh(uint32_t mesh, bool wait);
+
+	// Allocates ranges for faces[n] faces of each normal n of slot idx,
+	// in the slot's format and all in one page, adding a page if none has
+	// room and grow is set. Returns false if they do not fit.
+	bool alloc_ranges(uint32_t idx, const uint32_t faces[6],
+			  bool grow = true);
+	bool alloc_ranges_in(uint32_t idx, uint32_t page,
+			     const uint32_t units[6]);
+	void set_range(uint32_t idx, uint32_t normal,
+		       range_allocator::handle range);
+	void free_ranges(uint32_t idx);
+
+	void add_page();
+
+	// Moves the ranges at the end of each page into free ranges before
+	// them, up to render/compact_rate bytes a frame
+	void compact();
+
+	// Lays the mesh out in slot idx and uploads it
+	void write_mesh(uint32_t idx, const mc::world::chunk_mesh *mesh);
+	void write_faces(uint32_t idx, uint32_t normal, const void *faces,
+			 uint32_t count);
+	void write_info(uint32_t idx, const mc::world::face_id *textures,
+			uint32_t count);
+
+	void fill_commands(uint32_t idx, indirect_draw_command *cmds) const;
+
+	// Rewrites the draw commands and info of slot idx after its ranges
+	// changed within its page
+	void update_commands(uint32_t idx);
+
+	// Rewrites the instance models, draw commands and mesh infos, grouping
+	// the instances of each mesh and the meshes of each page
+	void update_instances();
+
 	void grow(uint32_t capacity);
 
     private:
 	std::stack<uint32_t> m_free;
-	GLuint m_chunks;
-	GLuint m_uniforms;
+	std::vector<mesh_slot> m_meshes;
+	std::unordered_map<uint64_t, uint32_t> m_mesh_cache;
+
+	// Content of the chunk upload_voxels() is meshing, kept for its storage
+	std::vector<uint8_t> m_content;
+
+	std::vector<chunk_slot> m_chunk_slots;
+	std::vector<chunk_handle> m_free_chunks;
+	bool m_dirty;
+
+	// Faces of every mesh, in ranges of packed_face units. Pages are only
+	// ever added, so growing never copies faces.
+	std::vector<std::unique_ptr<face_page> > m_pages;
+	uint32_t m_page_size;
+
+	// Every write into the renderer's buffers goes through the ring. It is
+	// flushed before they are otherwise read or written: by a draw, the
+	// meshing shader or a copy between buffers.
+	gl::staging_ring m_staging;
+
+	GLuint m_instances;
 	GLuint m_indirect;
+	GLuint m_mesh_info;
 	uint32_t m_capacity;
+	uint32_t m_instance_capacity;
+
+	// Two triangles over the four vertices of each face, shared by every
+	// draw, which selects its faces with the base vertex
+	GLuint m_quad_indices;
+	GLuint m_vao;
+
+	// Chunks meshed by the meshing shader; empty unless it is enabled
+	GLuint m_mesh_program;
+	GLint m_mesh_slot;
+	GLint m_mesh_offsets;
+
+	GLuint m_voxels;
+	GLuint m_blocks;
+	GLuint m_ao;
+	GLuint m_counts;
+	std::vector<gpu_mesh> m_gpu_meshes;
 
 	GLuint m_texarray;
 
@@ -41,6 +235,7 @@ class gl_world_renderer : public world_renderer {
 	GLint m_view;
 	GLint m_projection;
 	GLint m_texture;
+	GLint m_first_mesh;
 };
 }
 }
@@ -15,10 +15,19 @@ class vk_world_renderer : public world_renderer {
 	virtual chunk_handle alloc_chunk() override;
 	virtual void free_chunk(chunk_handle handle) override;
 
-	virtual void upload_chunk(chunk_handle handle,
-				  mc::world::chunk_draw_data *draw_data,
+	virtual void upload_chunk(chunk_handle handle, uint64_t hash,
+				  const mc::world::chunk_mesh *mesh,
 				  const glm::mat4 &model) override;
 
+	virtual void patch_chunk(chunk_handle handle, uint64_t hash,
+				 const mc::world::chunk_mesh *mesh,
+				 uint8_t normals) override;
+
+	virtual bool meshes_voxels() const override;
+	virtual void upload_voxels(chunk_handle handle, uint64_t hash,
+				   const mc::world::chunk *ch,
+				   const glm::mat4 &model) override;
+
 	virtual void render(const glm::mat4 &view,
 			    const glm::mat4 &projection) override;
 };
@@ -20,10 +20,32 @@ class world_renderer {
 	virtual chunk_handle alloc_chunk() = 0;
 	virtual void free_chunk(chunk_handle handle) = 0;
 
-	virtual void upload_chunk(chunk_handle handle,
-				  mc::world::chunk_draw_data *draw_data,
+	// Draws the chunk with the mesh identified by hash, usually the
+	// chunk's content hash, and the mesh's content. mesh is only read if
+	// no other chunk uses a mesh with both yet; chunks sharing a mesh are
+	// drawn as instances of it. Meshes without content are never shared.
+	virtual void upload_chunk(chunk_handle handle, uint64_t hash,
+				  const mc::world::chunk_mesh *mesh,
 				  const glm::mat4 &model) = 0;
 
+	// Replaces the faces of the given normals, a mask by block_face, of a
+	// chunk's mesh after a small edit, e.g. by world::patch_mesh(). Writes
+	// in place when the mesh is not shared and the faces fit; otherwise
+	// this is upload_chunk().
+	virtual void patch_chunk(chunk_handle handle, uint64_t hash,
+				 const mc::world::chunk_mesh *mesh,
+				 uint8_t normals) = 0;
+
+	// Whether upload_voxels() is available and enabled
+	virtual bool meshes_voxels() const = 0;
+
+	// As upload_chunk(), but the chunk is meshed by the renderer from its
+	// blocks, with the faces of the simple mesher. The chunk is only read
+	// during the call.
+	virtual void upload_voxels(chunk_handle handle, uint64_t hash,
+				   const mc::world::chunk *ch,
+				   const glm::mat4 &model) = 0;
+
 	virtual void render(const glm::mat4 &view,
 			    const glm::mat4 &projection) = 0;
 
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define MINECLONE_X86_64
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Compiles a function for an instruction set beyond the build's, so every
+// kernel variant exists whatever MINECLONE_SIMD selects. MSVC allows any
+// intrinsic without it.
+#if defined(__GNUC__) || defined(__clang__)
+#define MINECLONE_TARGET(isa) __attribute__((target(isa)))
+#else
+#define MINECLONE_TARGET(isa)
+#endif
+
+namespace mc
+{
+namespace world
+{
+// Transposes the nine AO sample rows of a row of 64 faces into indices of the
+// AO table: lo[i] holds bit i of words 0 to 7 and hi[i] bit i of word 8.
+//
+// The greedy mesher uses the variant MINECLONE_SIMD selects. The others are
+// there for tests and benchmarks, which must check that the CPU supports
+// them first.
+inline void gather_ao_indices_scalar(const uint64_t *words, uint8_t *lo,
+				     uint8_t *hi) noexcept
+{
+	for (int i = 0; i < 64; i++) {
+		uint8_t index = 0;
+		for (int b = 0; b < 8; b++) {
+			index |= ((words[b] >> i) & 1) << b;
+		}
+
+		lo[i] = index;
+		hi[i] = (words[8] >> i) & 1;
+	}
+}
+
+#ifdef MINECLONE_X86_64
+// A byte per bit of the low 16 bits, 0xff where the bit is set
+MINECLONE_TARGET("sse4.1")
+inline __m128i expand_bits_sse4(uint16_t bits) noexcept
+{
+	const __m128i shuffle = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+					      1, 1, 1, 1, 1, 1);
+	const __m128i select = _mm_set1_epi64x(0x8040201008040201ll);
+
+	__m128i v = _mm_shuffle_epi8(
+		_mm_set1_epi16(static_cast<short>(bits)), shuffle);
+	return _mm_cmpeq_epi8(_mm_and_si128(v, select), select);
+}
+
+MINECLONE_TARGET("sse4.1")
+inline void gather_ao_indices_sse4(const uint64_t *words, uint8_t *lo,
+				   uint8_t *hi) noexcept
+{
+	for (int quarter = 0; quarter < 64; quarter += 16) {
+		__m128i acc = _mm_setzero_si128();
+		for (int b = 0; b < 8; b++) {
+			__m128i set = expand_bits_sse4(words[b] >> quarter);
+			acc = _mm_or_si128(
+				acc,
+				_mm_and_si128(set,
+					      _mm_set1_epi8(static_cast<char>(
+						      1 << b))));
+		}
+
+		__m128i top = _mm_and_si128(
+			expand_bits_sse4(words[8] >> quarter),
+			_mm_set1_epi8(1));
+
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(lo + quarter),
+				 acc);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(hi + quarter),
+				 top);
+	}
+}
+
+// A byte per bit of the low 32 bits, 0xff where the bit is set
+MINECLONE_TARGET("avx2")
+inline __m256i expand_bits_avx2(uint32_t bits) noexcept
+{
+	const __m256i shuffle = _mm256_setr_epi8(
+		0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2,
+		2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+	const __m256i select = _mm256_set1_epi64x(0x8040201008040201ll);
+
+	__m256i v = _mm256_shuffle_epi8(_mm256_set1_epi32(bits), shuffle);
+	return _mm256_cmpeq_epi8(_mm256_and_si256(v, select), select);
+}
+
+MINECLONE_TARGET("avx2")
+inline void gather_ao_indices_avx2(const uint64_t *words, uint8_t *lo,
+				   uint8_t *hi) noexcept
+{
+	for (int half = 0; half < 64; half += 32) {
+		__m256i acc = _mm256_setzero_si256();
+		for (int b = 0; b < 8; b++) {
+			__m256i set = expand_bits_avx2(words[b] >> half);
+			acc = _mm256_or_si256(
+				acc, _mm256_and_si256(
+					     set, _mm256_set1_epi8(
+							  static_cast<char>(
+								  1 << b))));
+		}
+
+		__m256i top = _mm256_and_si256(
+			expand_bits_avx2(words[8] >> half),
+			_mm256_set1_epi8(1));
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(lo + half),
+				    acc);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(hi + half),
+				    top);
+	}
+}
+
+inline bool cpu_supports_sse4() noexcept
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] >> 19) & 1;
+#else
+	return __builtin_cpu_supports("sse4.1");
+#endif
+}
+
+inline bool cpu_supports_avx2() noexcept
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuidex(info, 7, 0);
+	return (info[1] >> 5) & 1;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+}
+}
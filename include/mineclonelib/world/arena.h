@@ -0,0 +1,201 @@
+#pragma once
+
+#include "mineclonelib/world/chunk.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#define SLAB_SIZE (2u << 20)
+
+// Smallest block a scratch_arena takes from the heap
+#define SCRATCH_BLOCK_SIZE (256u << 10)
+
+namespace mc
+{
+namespace world
+{
+// Maps size bytes aligned to SLAB_SIZE, backed by huge pages when asked and
+// available.
+void *map_slab(size_t size, bool huge_pages);
+void unmap_slab(void *slab, size_t size);
+
+// Pool of fixed-size objects carved out of SLAB_SIZE slabs. Objects never
+// move once allocated, so handles and pointers stay valid until free(), and
+// both alloc() and free() are O(1) apart from mapping a new slab.
+template <typename tp> class slab_arena {
+    public:
+	// 1-based, 0 is never a valid handle
+	using handle = uint32_t;
+
+	slab_arena(bool huge_pages = true)
+		: m_huge_pages(huge_pages)
+		, m_shift(0)
+		, m_size(0)
+	{
+		while ((sizeof(tp) << (m_shift + 1)) <= SLAB_SIZE) {
+			m_shift++;
+		}
+	}
+
+	~slab_arena()
+	{
+		for (handle h = 1; h <= m_live.size(); h++) {
+			if (m_live[h - 1]) {
+				get(h)->~tp();
+			}
+		}
+
+		for (tp *slab : m_slabs) {
+			unmap_slab(slab, SLAB_SIZE);
+		}
+	}
+
+	slab_arena(const slab_arena &) = delete;
+	slab_arena &operator=(const slab_arena &) = delete;
+
+	template <typename... args> handle alloc(args &&...a)
+	{
+		if (m_free.empty()) {
+			grow();
+		}
+
+		handle h = m_free.back();
+		m_free.pop_back();
+
+		new (get(h)) tp(std::forward<args>(a)...);
+		m_live[h - 1] = true;
+		m_size++;
+
+		return h;
+	}
+
+	void free(handle h)
+	{
+		get(h)->~tp();
+		m_live[h - 1] = false;
+		m_free.push_back(h);
+		m_size--;
+	}
+
+	inline tp *get(handle h) const noexcept
+	{
+		uint32_t idx = h - 1;
+		return m_slabs[idx >> m_shift] + (idx & ((1u << m_shift) - 1));
+	}
+
+	inline uint32_t size() const noexcept
+	{
+		return m_size;
+	}
+
+	inline uint32_t capacity() const noexcept
+	{
+		return m_live.size();
+	}
+
+    private:
+	void grow()
+	{
+		m_slabs.push_back(
+			static_cast<tp *>(map_slab(SLAB_SIZE, m_huge_pages)));
+
+		uint32_t first = m_live.size() + 1;
+		uint32_t count = 1u << m_shift;
+		m_live.resize(m_live.size() + count, false);
+
+		for (handle h = first + count - 1; h >= first; h--) {
+			m_free.push_back(h);
+		}
+	}
+
+    private:
+	bool m_huge_pages;
+	uint32_t m_shift;
+	uint32_t m_size;
+
+	std::vector<tp *> m_slabs;
+	std::vector<handle> m_free;
+	std::vector<bool> m_live;
+};
+
+using chunk_arena = slab_arena<chunk>;
+
+// Bump allocator for the temporaries of one job, such as meshing a chunk.
+// Everything is freed at once when the outermost scratch_scope ends, and the
+// memory is kept for the next job: blocks taken from the heap are merged into
+// one, so a thread repeating the same kind of work stops allocating.
+class scratch_arena {
+    public:
+	scratch_arena();
+
+	scratch_arena(const scratch_arena &) = delete;
+	scratch_arena &operator=(const scratch_arena &) = delete;
+
+	// The calling thread's arena
+	static scratch_arena &get();
+
+	void *allocate(size_t size, size_t align);
+
+	// Uninitialised storage for count objects
+	template <typename tp> tp *allocate(size_t count)
+	{
+		static_assert(std::is_trivially_destructible_v<tp>);
+		return static_cast<tp *>(
+			allocate(count * sizeof(tp), alignof(tp)));
+	}
+
+	size_t capacity() const noexcept;
+
+	// Blocks taken from the heap since the arena was created
+	inline uint64_t get_heap_allocations() const noexcept
+	{
+		return m_heap_allocations;
+	}
+
+    private:
+	friend class scratch_scope;
+
+	struct block {
+		std::unique_ptr<std::byte[]> data;
+		size_t size;
+	};
+
+	// Called when the outermost scope ends
+	void reset();
+
+    private:
+	std::vector<block> m_blocks;
+	size_t m_block;
+	size_t m_offset;
+
+	uint32_t m_depth;
+	uint64_t m_heap_allocations;
+};
+
+// Frees everything allocated from the calling thread's arena after it was
+// created when it goes out of scope
+class scratch_scope {
+    public:
+	scratch_scope();
+	~scratch_scope();
+
+	scratch_scope(const scratch_scope &) = delete;
+	scratch_scope &operator=(const scratch_scope &) = delete;
+
+	template <typename tp> inline tp *allocate(size_t count)
+	{
+		return m_arena.allocate<tp>(count);
+	}
+
+    private:
+	scratch_arena &m_arena;
+	size_t m_block;
+	size_t m_offset;
+};
+}
+}
@@ -8,7 +8,7 @@ namespace mc
 {
 namespace world
 {
-using block_id = uint8_t;
+using block_id = uint16_t;
 using face_id = uint16_t;
 
 class face {
@@ -24,6 +24,7 @@ class face_registry {
 	face_registry() = default;
 	~face_registry() = default;
 
+	// Faces must be registered before the block properties are built
 	face_id register_face(std::unique_ptr<face> &&face);
 
 	inline face *get(face_id face) const noexcept
@@ -36,8 +37,15 @@ class face_registry {
 		return m_faces.size();
 	}
 
+	// Called when the block properties are built from the registry
+	inline void freeze() noexcept
+	{
+		m_frozen = true;
+	}
+
     private:
 	std::vector<std::unique_ptr<face> > m_faces;
+	bool m_frozen = false;
 };
 
 enum class block_face {
@@ -74,6 +82,8 @@ class block_registry {
 	block_registry() = default;
 	~block_registry() = default;
 
+	// Blocks must be registered before the block properties are built,
+	// which hold an entry per block
 	block_id register_block(std::unique_ptr<block> &&block);
 
 	inline block *get(block_id block) const noexcept
@@ -81,8 +91,61 @@ class block_registry {
 		return m_blocks[block].get();
 	}
 
+	inline uint32_t size() const noexcept
+	{
+		return m_blocks.size();
+	}
+
+	// Called when the block properties are built from the registry
+	inline void freeze() noexcept
+	{
+		m_frozen = true;
+	}
+
     private:
 	std::vector<std::unique_ptr<block> > m_blocks;
+	bool m_frozen = false;
+};
+
+// Frozen, contiguous copy of the block and face registries for hot loops,
+// which read it without pointer chasing or virtual calls.
+class block_properties {
+    public:
+	block_properties(const block_registry *breg, const face_registry *freg);
+	~block_properties() = default;
+
+	inline bool is_opaque(block_id block) const noexcept
+	{
+		return (m_opaque[block >> 6] >> (block & 63)) & 1;
+	}
+
+	inline face_id get_face(block_id block, block_face face) const noexcept
+	{
+		return m_faces[block * 6 + static_cast<int>(face)];
+	}
+
+	// A face is renderable if it has a texture
+	inline bool is_renderable(face_id face) const noexcept
+	{
+		return (m_renderable[face >> 6] >> (face & 63)) & 1;
+	}
+
+	// Bit k is set if face k of block is renderable
+	inline uint8_t get_renderable_faces(block_id block) const noexcept
+	{
+		return m_renderable_faces[block];
+	}
+
+	inline uint32_t size() const noexcept
+	{
+		return m_renderable_faces.size();
+	}
+
+    private:
+	std::vector<uint64_t> m_opaque;
+	std::vector<face_id> m_faces;
+	std::vector<uint64_t> m_renderable;
+	std::vector<uint8_t> m_renderable_faces;
 };
 
 namespace faces
@@ -97,6 +160,10 @@ namespace blocks
 {
 block_registry *get_registry();
 
+// Built on first use, so every block and face must be registered by then;
+// registering one later fails an assertion
+const block_properties *get_properties();
+
 extern block_id air;
 extern block_id dirt;
 }
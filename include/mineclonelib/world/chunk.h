@@ -1,56 +1,588 @@
 #pragma once
 
+// Size of the engine's chunks, as log2 of their edge. Override it at build
+// time to compare chunk sizes; chunk_dims and the basic_* templates below
+// take it as a parameter so several sizes can live side by side.
+#ifndef CHUNK_SIZE_LOG
 #define CHUNK_SIZE_LOG 6
-#define CHUNK_SIZE 64
+#endif
+
+#define CHUNK_SIZE (1 << CHUNK_SIZE_LOG)
 #define CHUNK_PADDING 1
 #define CHUNK_BEGIN (CHUNK_PADDING)
 #define CHUNK_END (CHUNK_SIZE + CHUNK_PADDING)
 #define CHUNK_TOTAL (CHUNK_SIZE + 2 * CHUNK_PADDING)
+#define CHUNK_COLUMN_MASK (~0ull >> (64 - CHUNK_SIZE))
 
 #include "mineclonelib/world/blocks.h"
+#include "mineclonelib/world/cold.h"
+#include "mineclonelib/world/palette.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <memory>
 
 namespace mc
 {
 namespace world
 {
+template <uint32_t size_log> struct chunk_dims {
+	static_assert(size_log >= 3 && size_log <= 6,
+		      "Chunk columns must fit in 64 bits");
+
+	static constexpr int log = size_log;
+	static constexpr int size = 1 << size_log;
+	static constexpr int padding = 1;
+	static constexpr int begin = padding;
+	static constexpr int end = size + padding;
+	static constexpr int total = size + 2 * padding;
+	static constexpr uint64_t column_mask = ~0ull >> (64 - size);
+
+	// Change tracking granularity, in 8x8x8 block sections
+	static constexpr int section_log = 3;
+	static constexpr int section_size = 1 << section_log;
+	static constexpr int sections_per_axis = size >> section_log;
+	static constexpr int sections =
+		sections_per_axis * sections_per_axis * sections_per_axis;
+
+	// Most faces a chunk can have, from a 3D checkerboard
+	static constexpr int max_faces = size * size * size * 3;
+};
+
 struct face_draw_data {
 	face_id face;
 	block_face normal;
 	uint8_t ao;
 	uint8_t x, y, z;
+
+	// Size of a merged quad, in blocks, along the left and top axes of its
+	// normal as the chunk shader defines them
+	uint8_t w = 1, h = 1;
 };
 
 struct chunk_draw_data {
 	std::vector<face_draw_data> faces;
 };
 
-struct chunk {
-	block_id blocks[CHUNK_TOTAL][CHUNK_TOTAL][CHUNK_TOTAL] = {};
+// A face in the format the renderers upload
+struct packed_face {
+	uint32_t geometry;
+	uint32_t shading;
+};
+
+// Coordinates are stored relative to the first interior block, so each one
+// fits in size_log bits. Quad sizes are stored minus one for the same reason,
+// above the 16-bit face id.
+template <uint32_t size_log>
+inline packed_face pack_face(const face_draw_data &face) noexcept
+{
+	using dims = chunk_dims<size_log>;
+
+	uint32_t geometry =
+		(static_cast<uint32_t>(face.x - dims::begin)) |
+		(static_cast<uint32_t>(face.y - dims::begin) << (size_log)) |
+		(static_cast<uint32_t>(face.z - dims::begin)
+		 << (2 * size_log)) |
+		(static_cast<uint32_t>(face.ao) << (3 * size_log));
+
+	uint32_t shading =
+		face.face | (static_cast<uint32_t>(face.w - 1) << 16) |
+		(static_cast<uint32_t>(face.h - 1) << (16 + size_log));
+
+	return { geometry, shading };
+}
+
+// Inverse of pack_face(), except for the normal, which is not packed
+template <uint32_t size_log>
+inline face_draw_data unpack_face(const packed_face &packed) noexcept
+{
+	using dims = chunk_dims<size_log>;
+	const uint32_t mask = dims::size - 1;
+
+	face_draw_data face;
+	face.face = packed.shading & 0xffff;
+	face.ao = (packed.geometry >> (3 * size_log)) & 0xff;
+	face.x = (packed.geometry & mask) + dims::begin;
+	face.y = ((packed.geometry >> size_log) & mask) + dims::begin;
+	face.z = ((packed.geometry >> (2 * size_log)) & mask) + dims::begin;
+	face.w = ((packed.shading >> 16) & mask) + 1;
+	face.h = ((packed.shading >> (16 + size_log)) & mask) + 1;
+
+	return face;
+}
+
+// Most textures a mesh in the compact format can use
+#define COMPACT_TEXTURES 64
+
+// Re-encodes faces in the compact format, half the size of packed_face: the
+// geometry word with an index into a texture table of the mesh in its top
+// bits. Only meshes of unmerged faces using at most COMPACT_TEXTURES
+// textures fit. Returns the size of the table written to textures, or 0 if
+// the faces do not fit, in which case dst is left partly written.
+template <uint32_t size_log>
+inline uint32_t compact_faces(const packed_face *faces, size_t count,
+			      uint32_t *dst, face_id *textures) noexcept
+{
+	const uint32_t shift = 3 * size_log + 8;
+	static_assert(3 * size_log + 8 + 6 <= 32);
+
+	uint32_t size = 0;
+	uint32_t last = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		// Quad sizes sit above the face id and are 0 for one block
+		if ((faces[i].shading >> 16) != 0) {
+			return 0;
+		}
+
+		face_id face = faces[i].shading;
+		if (size == 0 || textures[last] != face) {
+			last = 0;
+			while (last < size && textures[last] != face) {
+				last++;
+			}
+
+			if (last == size) {
+				if (size == COMPACT_TEXTURES) {
+					return 0;
+				}
+
+				textures[size++] = face;
+			}
+		}
+
+		dst[i] = faces[i].geometry | last << shift;
+	}
+
+	return size;
+}
+
+// Packs faces straight into a caller-provided buffer, which may be mapped
+// GPU memory, with room for chunk_dims::max_faces. Generators emit faces in
+// block_face order, so each normal ends up as one contiguous region.
+template <uint32_t size_log> class basic_face_sink {
+    public:
+	basic_face_sink(packed_face *dst)
+		: m_dst(dst)
+		, m_count(0)
+		, m_ends{}
+	{
+	}
+
+	inline void push(const face_draw_data &face) noexcept
+	{
+		m_dst[m_count++] = pack_face<size_log>(face);
+		m_ends[static_cast<int>(face.normal)] = m_count;
+	}
+
+	// Normals without faces leave their entry of m_ends at zero
+	inline uint32_t get_offset(block_face normal) const noexcept
+	{
+		uint32_t offset = 0;
+		for (int n = 0; n < static_cast<int>(normal); n++) {
+			offset = std::max(offset, m_ends[n]);
+		}
+
+		return offset;
+	}
+
+	inline uint32_t get_count(block_face normal) const noexcept
+	{
+		uint32_t offset = get_offset(normal);
+		return std::max(m_ends[static_cast<int>(normal)], offset) -
+		       offset;
+	}
+
+	inline uint32_t size() const noexcept
+	{
+		return m_count;
+	}
+
+	inline const packed_face *data() const noexcept
+	{
+		return m_dst;
+	}
+
+    private:
+	packed_face *m_dst;
+	uint32_t m_count;
+	uint32_t m_ends[6];
+};
+
+// Packed faces of a chunk, those of each normal following the previous one
+struct chunk_mesh {
+	std::vector<packed_face> faces;
+	uint32_t counts[6];
+
+	// The chunk's encode_content() when it was meshed, or empty if the
+	// mesh may not be shared with other chunks of the same content hash,
+	// as after patch_mesh().
+	std::vector<uint8_t> content;
+};
+
+// Opacity of every block in a padded chunk, stored as 64-bit columns along
+// each axis. Bit i of a column is the interior block begin + i along that
+// axis; the other two coordinates index the column in padded chunk space.
+// Halo blocks show up in the columns of the axes along which they are
+// interior, and the 8 halo corners are kept separately.
+template <uint32_t size_log> class basic_occupancy {
+    public:
+	using dims = chunk_dims<size_log>;
+
+	basic_occupancy(bool opaque);
+	~basic_occupancy() = default;
+
+	// Column along x at (y, z)
+	inline uint64_t column_x(int y, int z) const noexcept
+	{
+		return m_x[y][z];
+	}
+
+	// Column along y at (x, z)
+	inline uint64_t column_y(int x, int z) const noexcept
+	{
+		return m_y[x][z];
+	}
+
+	// Column along z at (x, y)
+	inline uint64_t column_z(int x, int y) const noexcept
+	{
+		return m_z[x][y];
+	}
+
+	// Column along axis, at the coordinates of the two other axes in
+	// x, y, z order
+	inline uint64_t column(int axis, int a, int b) const noexcept
+	{
+		return axis == 0 ? m_x[a][b] :
+		       axis == 1 ? m_y[a][b] :
+				   m_z[a][b];
+	}
+
+	bool get(int x, int y, int z) const noexcept;
+	void set(int x, int y, int z, bool opaque) noexcept;
+
+    private:
+	uint64_t m_x[dims::total][dims::total];
+	uint64_t m_y[dims::total][dims::total];
+	uint64_t m_z[dims::total][dims::total];
+	uint8_t m_corners;
+};
+
+template <uint32_t size_log> class basic_chunk {
+    public:
+	using dims = chunk_dims<size_log>;
+	using occupancy_type = basic_occupancy<size_log>;
+	using section_mask = std::bitset<dims::sections>;
+
+	basic_chunk(block_id fill = 0);
+	~basic_chunk() = default;
+
+	// Copies a version of the chunk, neighbour links included
+	basic_chunk(const basic_chunk &other);
+	basic_chunk &operator=(const basic_chunk &) = delete;
 
 	inline block_id get(int x, int y, int z) const noexcept
 	{
-		return blocks[x][y][z];
+		ensure_resident();
+		return m_storage.get(index(x, y, z));
+	}
+
+	// Setting a block on the interior boundary also writes it into the halo
+	// of every linked neighbour that can see it.
+	inline void set(int x, int y, int z, block_id block)
+	{
+		store(x, y, z, block);
+
+		if (is_border(x) || is_border(y) || is_border(z)) {
+			propagate(x, y, z, block);
+		}
 	}
 
-	inline void set(int x, int y, int z, block_id block) noexcept
+	inline bool is_opaque(int x, int y, int z) const noexcept
 	{
-		blocks[x][y][z] = block;
+		ensure_resident();
+
+		if (m_occupancy == nullptr) {
+			return m_opaque;
+		}
+
+		return m_occupancy->get(x, y, z);
 	}
+
+	// Opacity columns, or nullptr while every block in the chunk has the
+	// same opacity (see is_opaque()).
+	inline const occupancy_type *get_occupancy() const noexcept
+	{
+		ensure_resident();
+		return m_occupancy.get();
+	}
+
+	// Sets every block, padding included, to block. Halos are not pushed to
+	// neighbours; use this before the chunk is linked.
+	void fill(block_id block);
+
+	inline basic_chunk *get_neighbour(int dx, int dy, int dz) const noexcept
+	{
+		return m_neighbours[neighbour_index(dx, dy, dz)];
+	}
+
+	inline void link(int dx, int dy, int dz, basic_chunk *n) noexcept
+	{
+		m_neighbours[neighbour_index(dx, dy, dz)] = n;
+	}
+
+	// Copies the blocks of the neighbour at (dx, dy, dz) that fall in this
+	// chunk's halo.
+	void pull_halo(int dx, int dy, int dz);
+
+	// Incremented by every block change, halo included
+	inline uint32_t get_generation() const noexcept
+	{
+		return m_generation;
+	}
+
+	// Sections with a block changed after generation. A halo block counts
+	// towards the interior section it touches. Faces and AO also depend on
+	// adjacent blocks, so mesh consumers should dilate() the result.
+	section_mask changed_since(uint32_t generation) const noexcept;
+
+	// Changes since the last clear_dirty()
+	inline bool is_dirty() const noexcept
+	{
+		return m_generation != m_clean_generation;
+	}
+
+	inline section_mask dirty_sections() const noexcept
+	{
+		return changed_since(m_clean_generation);
+	}
+
+	inline void clear_dirty() noexcept
+	{
+		m_clean_generation = m_generation;
+	}
+
+	// Grows a section mask by one section along every axis
+	static section_mask dilate(const section_mask &mask) noexcept;
+
+	static inline uint32_t section_index(int x, int y, int z) noexcept
+	{
+		const int n = dims::sections_per_axis;
+		return ((section_of(x) * n) + section_of(y)) * n +
+		       section_of(z);
+	}
+
+	inline void compact()
+	{
+		ensure_resident();
+		m_storage.compact();
+	}
+
+	inline const palette_storage &get_storage() const noexcept
+	{
+		ensure_resident();
+		return m_storage;
+	}
+
+	// Replaces the resident storage and occupancy with compressed, the
+	// palette_storage::encode() output of this chunk's current contents.
+	// Any accessor transparently decompresses the chunk again.
+	void freeze(std::vector<uint8_t> &&compressed);
+
+	inline bool is_cold() const noexcept
+	{
+		return m_is_cold.load(std::memory_order_acquire);
+	}
+
+	// Records an access at the current access_clock
+	inline void touch() const noexcept
+	{
+		uint32_t now = access_clock.load(std::memory_order_relaxed);
+		m_last_access.store(now, std::memory_order_relaxed);
+	}
+
+	inline uint32_t get_last_access() const noexcept
+	{
+		return m_last_access.load(std::memory_order_relaxed);
+	}
+
+	// World epoch in which this version of the chunk was created
+	inline uint64_t get_epoch() const noexcept
+	{
+		return m_epoch;
+	}
+
+	inline void set_epoch(uint64_t epoch) noexcept
+	{
+		m_epoch = epoch;
+	}
+
+	// True when every block, padding included, is the same. Such chunks
+	// take no index storage and produce no faces.
+	inline bool is_uniform() const noexcept
+	{
+		return m_storage.is_uniform();
+	}
+
+	// Decodes all dims::total^3 blocks, in index() order, into dst.
+	inline void unpack(block_id *dst) const noexcept
+	{
+		ensure_resident();
+		touch();
+		m_storage.unpack(dst);
+	}
+
+	// Hash of every block, halo included, which is all a mesh depends on,
+	// so equal hashes can share a mesh wherever the chunks are.
+	uint64_t content_hash() const;
+
+	// Appends every block, halo included, to out in a canonical encoding:
+	// equal for chunks with equal blocks, whatever their palettes, and
+	// different otherwise. Confirms that chunks with the same
+	// content_hash() really can share a mesh.
+	void encode_content(std::vector<uint8_t> &out) const;
+
+	inline size_t memory_usage() const noexcept
+	{
+		return sizeof(*this) - sizeof(m_storage) +
+		       m_storage.memory_usage() + m_cold.capacity() +
+		       (m_occupancy != nullptr ? sizeof(occupancy_type) : 0);
+	}
+
+	static inline uint32_t index(int x, int y, int z) noexcept
+	{
+		return (x * dims::total + y) * dims::total + z;
+	}
+
+	static inline int neighbour_index(int dx, int dy, int dz) noexcept
+	{
+		return (dx + 1) * 9 + (dy + 1) * 3 + (dz + 1);
+	}
+
+    private:
+	inline void store(int x, int y, int z, block_id block)
+	{
+		ensure_resident();
+		touch();
+
+		m_storage.set(index(x, y, z), block);
+		update_occupancy(x, y, z, block);
+		m_sections[section_index(x, y, z)] = ++m_generation;
+	}
+
+	// Section coordinate of a padded coordinate, clamping the halo
+	static inline int section_of(int c) noexcept
+	{
+		c = (c < dims::begin ? dims::begin :
+		     c >= dims::end  ? dims::end - 1 :
+				       c);
+		return (c - dims::begin) >> dims::section_log;
+	}
+
+	static inline bool is_border(int c) noexcept
+	{
+		return c == dims::begin || c == dims::end - 1;
+	}
+
+	// Decompression is logically const, as it does not change any block,
+	// and may happen on any thread reading the chunk.
+	inline void ensure_resident() const
+	{
+		if (m_is_cold.load(std::memory_order_acquire)) {
+			const_cast<basic_chunk *>(this)->thaw();
+		}
+	}
+
+	void thaw();
+	void rebuild_occupancy();
+
+	void update_occupancy(int x, int y, int z, block_id block);
+	void propagate(int x, int y, int z, block_id block);
+
+    private:
+	palette_storage m_storage;
+	std::vector<uint8_t> m_cold;
+	std::atomic<bool> m_is_cold;
+	mutable std::atomic<uint32_t> m_last_access;
+
+	std::unique_ptr<occupancy_type> m_occupancy;
+	bool m_opaque;
+
+	uint64_t m_epoch;
+	uint32_t m_generation;
+	uint32_t m_clean_generation;
+	uint32_t m_sections[dims::sections];
+
+	// Indexed by neighbour_index(), the middle entry is unused
+	basic_chunk *m_neighbours[27];
 };
 
-class chunk_draw_data_generator {
+template <uint32_t size_log> class basic_chunk_draw_data_generator {
     public:
-	virtual ~chunk_draw_data_generator() = default;
+	virtual ~basic_chunk_draw_data_generator() = default;
+
+	virtual chunk_draw_data
+	generate(const basic_chunk<size_log> *ch) const = 0;
 
-	virtual chunk_draw_data generate(chunk *ch) const = 0;
+	virtual void generate(const basic_chunk<size_log> *ch,
+			      basic_face_sink<size_log> &sink) const = 0;
 };
 
-class simple_chunk_draw_data_generator final
-	: public chunk_draw_data_generator {
+template <uint32_t size_log>
+class basic_simple_chunk_draw_data_generator final
+	: public basic_chunk_draw_data_generator<size_log> {
     public:
-	virtual ~simple_chunk_draw_data_generator() = default;
+	virtual ~basic_simple_chunk_draw_data_generator() = default;
+
+	virtual chunk_draw_data
+	generate(const basic_chunk<size_log> *ch) const override;
 
-	virtual chunk_draw_data generate(chunk *ch) const override;
+	virtual void generate(const basic_chunk<size_log> *ch,
+			      basic_face_sink<size_log> &sink) const override;
 };
+
+// Binary greedy meshing: faces are culled a 64-bit column at a time, then
+// coplanar faces with the same texture and flat ambient occlusion are merged
+// into quads. The simple generator remains the reference output.
+template <uint32_t size_log>
+class basic_greedy_chunk_draw_data_generator final
+	: public basic_chunk_draw_data_generator<size_log> {
+    public:
+	virtual ~basic_greedy_chunk_draw_data_generator() = default;
+
+	virtual chunk_draw_data
+	generate(const basic_chunk<size_log> *ch) const override;
+
+	virtual void generate(const basic_chunk<size_log> *ch,
+			      basic_face_sink<size_log> &sink) const override;
+};
+
+// Corner AO of a face, as stored in face_draw_data::ao, by the opacity of
+// the nine blocks sampled around the block in front of it. Bit 3i + j is
+// set when the sample i - 1 blocks along the sampled left axis and j - 1
+// along the top axis is opaque.
+uint8_t get_face_ao(uint32_t samples) noexcept;
+
+// Updates mesh after the block at (x, y, z), in padded chunk coordinates,
+// changed: quads overlapping the 3x3x3 box around it are cut back to the
+// parts outside the box, and the faces inside are rebuilt unmerged. Returns
+// a mask of the normals whose faces changed. Far cheaper than remeshing,
+// but repeated patches fragment the mesh until it is next remeshed. Clears
+// the mesh's content, which it no longer matches.
+template <uint32_t size_log>
+uint8_t patch_mesh(const basic_chunk<size_log> *ch, int x, int y, int z,
+		   chunk_mesh &mesh);
+
+using occupancy = basic_occupancy<CHUNK_SIZE_LOG>;
+using chunk = basic_chunk<CHUNK_SIZE_LOG>;
+using face_sink = basic_face_sink<CHUNK_SIZE_LOG>;
+using chunk_draw_data_generator =
+	basic_chunk_draw_data_generator<CHUNK_SIZE_LOG>;
+using simple_chunk_draw_data_generator =
+	basic_simple_chunk_draw_data_generator<CHUNK_SIZE_LOG>;
+using greedy_chunk_draw_data_generator =
+	basic_greedy_chunk_draw_data_generator<CHUNK_SIZE_LOG>;
 }
 }
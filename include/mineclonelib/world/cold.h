@@ -0,0 +1,89 @@
+#pragma once
+
+#include "mineclonelib/world/palette.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mc
+{
+namespace world
+{
+// Coarse clock, in seconds, that chunks stamp on access. Advanced by
+// world_state::update_cold_tier().
+extern std::atomic<uint32_t> access_clock;
+
+// Sets access_clock to the seconds elapsed since startup
+void advance_access_clock();
+
+struct cold_tier_stats {
+	uint64_t compressed;
+	uint64_t decompressed;
+
+	// Resident size of the storage of compressed chunks, before and after
+	uint64_t raw_bytes;
+	uint64_t compressed_bytes;
+
+	// Total and longest time spent decompressing a single chunk
+	uint64_t decompress_ns;
+	uint64_t decompress_max_ns;
+};
+
+// Counters shared by every chunk; the compression side is updated by the
+// owner thread when a compressed chunk is installed.
+struct cold_tier_counters {
+	std::atomic<uint64_t> compressed;
+	std::atomic<uint64_t> decompressed;
+	std::atomic<uint64_t> raw_bytes;
+	std::atomic<uint64_t> compressed_bytes;
+	std::atomic<uint64_t> decompress_ns;
+	std::atomic<uint64_t> decompress_max_ns;
+};
+
+cold_tier_counters &get_cold_tier_counters();
+cold_tier_stats get_cold_tier_stats();
+
+// Counts a chunk decompressed in ns nanoseconds
+void record_decompression(uint64_t ns);
+
+// Background worker compressing copies of chunk storage. The owner thread
+// submits jobs and later collects the results, so the worker never touches
+// a live chunk. The worker thread starts with the first submitted job.
+class cold_tier {
+    public:
+	struct job {
+		uint64_t id;
+		uint64_t key;
+		uint32_t generation;
+		palette_storage storage;
+		std::vector<uint8_t> compressed;
+	};
+
+	cold_tier();
+	~cold_tier();
+
+	cold_tier(const cold_tier &) = delete;
+	cold_tier &operator=(const cold_tier &) = delete;
+
+	void submit(job &&j);
+	void collect(std::vector<job> &done);
+
+    private:
+	void run();
+
+    private:
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	bool m_run;
+
+	std::deque<job> m_queue;
+	std::vector<job> m_done;
+};
+}
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace mc
+{
+namespace world
+{
+void write_varint(std::vector<uint8_t> &out, uint32_t value);
+bool read_varint(const uint8_t *&src, const uint8_t *end, uint32_t &value);
+
+// Byte-oriented LZ77 codec in the style of LZ4: sequences of literals and
+// back-references of at least 4 bytes within a 64 KiB window. Favours
+// decompression speed over ratio.
+void lz_compress(const uint8_t *src, size_t size, std::vector<uint8_t> &out);
+
+// Returns false if src is malformed or does not decode to exactly size
+// bytes.
+bool lz_decompress(const uint8_t *src, size_t src_size, uint8_t *dst,
+		   size_t size);
+}
+}
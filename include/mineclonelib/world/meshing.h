@@ -0,0 +1,143 @@
+#pragma once
+
+#include "mineclonelib/world/chunk.h"
+#include "mineclonelib/world/world.h"
+
+#include <glm/glm.hpp>
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace tf
+{
+class Executor;
+}
+
+namespace mc
+{
+namespace world
+{
+// Meshes chunks on a taskflow executor. Requests are served nearest to the
+// camera first. A request for a chunk that is already queued replaces it,
+// and a result is dropped if a newer generation of its chunk was requested
+// while it was being meshed. Finished meshes wait in a completion queue
+// until collected, so callers can upload them in bounded batches.
+//
+// Chunks with the same blocks, halo included, share a mesh: a chunk whose
+// content hash matches a mesh still referenced by any result, and whose
+// blocks match those the mesh was built from, is not meshed again. Callers
+// that keep results around widen that window.
+//
+// Once a worker is warm, a chunk served from the cache allocates nothing,
+// and a chunk meshed anew allocates only its mesh, the mesh's faces and
+// content, and its cache entry.
+//
+// Requests read chunks through the snapshot they were made with, so the
+// service must be destroyed before the world it meshes.
+class meshing_service {
+    public:
+	struct result {
+		glm::ivec3 coords;
+		uint32_t generation;
+
+		// Content hash of the chunk, which identifies the mesh together
+		// with the mesh's content
+		uint64_t hash;
+		std::shared_ptr<const chunk_mesh> mesh;
+	};
+
+	meshing_service(tf::Executor *executor,
+			std::unique_ptr<chunk_draw_data_generator> generator);
+	~meshing_service();
+
+	meshing_service(const meshing_service &) = delete;
+	meshing_service &operator=(const meshing_service &) = delete;
+
+	// Queues the chunk at coords as it is in snapshot. Does nothing if the
+	// same generation of the chunk is queued or meshed but not collected
+	// yet; once collected, requesting it again meshes it again, which the
+	// mesh cache makes cheap while the previous result is alive.
+	void request(const std::shared_ptr<world_snapshot> &snapshot,
+		     const glm::ivec3 &coords);
+
+	// Forgets the chunk, e.g. when it is unloaded. A mesh in flight is
+	// dropped when it completes.
+	void cancel(const glm::ivec3 &coords);
+
+	// Reorders the queue by distance to the camera of the view matrix
+	void set_view(const glm::mat4 &view);
+
+	// Moves up to max finished meshes into out and returns their count.
+	// May be called from any thread.
+	size_t collect(std::vector<result> &out, size_t max);
+
+	size_t get_queued() const;
+
+    private:
+	struct job {
+		float distance;
+		uint64_t ticket;
+		uint64_t key;
+		glm::ivec3 coords;
+		uint32_t generation;
+		std::shared_ptr<world_snapshot> snapshot;
+	};
+
+	struct completed {
+		uint64_t ticket;
+		result res;
+	};
+
+	// Latest request per chunk, kept until its result is collected
+	struct latest {
+		uint64_t ticket;
+		uint32_t generation;
+		bool queued;
+	};
+
+	float distance_to(const glm::ivec3 &coords) const noexcept;
+
+	static bool further(const job &a, const job &b) noexcept;
+
+	// Called with m_mutex held
+	bool pop(job &j);
+	void dispatch();
+
+	void run();
+
+	std::shared_ptr<const chunk_mesh> find_mesh(uint64_t hash);
+	std::shared_ptr<const chunk_mesh>
+	generate(const chunk *ch, const std::vector<uint8_t> &content) const;
+
+	// Called with m_mutex held
+	void prune_meshes();
+
+    private:
+	tf::Executor *m_executor;
+	std::unique_ptr<chunk_draw_data_generator> m_generator;
+
+	mutable std::mutex m_mutex;
+	std::condition_variable m_idle;
+
+	// Min-heap on distance; superseded jobs are skipped when popped
+	std::vector<job> m_queue;
+	std::unordered_map<uint64_t, latest> m_latest;
+	std::vector<completed> m_completed;
+
+	// Meshes by content hash; expired entries are pruned as the map grows
+	std::unordered_map<uint64_t, std::weak_ptr<const chunk_mesh> > m_meshes;
+	size_t m_prune_at;
+
+	uint64_t m_ticket;
+	uint32_t m_queued;
+	uint32_t m_running;
+	uint32_t m_max_running;
+
+	glm::vec3 m_camera;
+};
+}
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "mineclonelib/world/blocks.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace mc
+{
+namespace world
+{
+// Block storage made of a small local palette and bit-packed indices into it.
+// A storage holding a single block uses 0-bit indices and no index words at
+// all; it is promoted to 1 bit on the first differing set() and widened to
+// 2, 4, 8 and 16 bits on demand, so an index never straddles two words.
+class palette_storage {
+    public:
+	palette_storage(uint32_t size, block_id fill = 0);
+	~palette_storage() = default;
+
+	inline block_id get(uint32_t idx) const noexcept
+	{
+		uint32_t bit = idx * m_bits;
+		uint64_t word = m_words[bit >> 6];
+		return m_palette[(word >> (bit & 63)) & m_mask];
+	}
+
+	inline void set(uint32_t idx, block_id block)
+	{
+		uint32_t local = index_of(block);
+		uint32_t bit = idx * m_bits;
+		uint64_t &word = m_words[bit >> 6];
+		word = (word & ~(m_mask << (bit & 63))) |
+		       (static_cast<uint64_t>(local) << (bit & 63));
+	}
+
+	void unpack(block_id *dst) const noexcept;
+
+	// Resets every index to block, dropping back to a uniform storage.
+	void fill(block_id block);
+
+	// Drops unused palette entries and narrows the indices to match.
+	void compact();
+
+	// Serialises the palette and run-length coded indices, LZ compressed
+	void encode(std::vector<uint8_t> &out) const;
+
+	// Restores the storage from encode() output
+	bool decode(const uint8_t *data, size_t size);
+
+	// Frees the index words; the storage is unusable until decode()
+	void release();
+
+	inline bool is_uniform() const noexcept
+	{
+		return m_bits == 0;
+	}
+
+	inline uint32_t size() const noexcept
+	{
+		return m_size;
+	}
+
+	inline uint32_t bits() const noexcept
+	{
+		return m_bits;
+	}
+
+	inline const std::vector<block_id> &palette() const noexcept
+	{
+		return m_palette;
+	}
+
+	size_t memory_usage() const noexcept;
+
+    private:
+	inline uint32_t index_of(block_id block)
+	{
+		if (m_palette[m_last] == block) {
+			return m_last;
+		}
+
+		return find_or_insert(block);
+	}
+
+	uint32_t find_or_insert(block_id block);
+	void repack(uint32_t bits, const uint32_t *remap);
+
+    private:
+	uint32_t m_size;
+	uint32_t m_bits;
+	uint64_t m_mask;
+	uint32_t m_last;
+
+	std::vector<block_id> m_palette;
+	std::vector<uint64_t> m_words;
+};
+}
+}
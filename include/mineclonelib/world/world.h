@@ -1,18 +1,276 @@
 #pragma once
 
+#include "mineclonelib/world/arena.h"
 #include "mineclonelib/world/chunk.h"
 
 #include <glm/glm.hpp>
 
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace mc
 {
 namespace world
 {
-struct world_state {
-	std::vector<world::chunk> chunks;
-	std::vector<glm::ivec3> coords;
+// Packs chunk coordinates into a 64-bit key, 21 bits per axis.
+inline uint64_t pack_coords(const glm::ivec3 &coords) noexcept
+{
+	const uint64_t mask = (1ull << 21) - 1;
+	return ((static_cast<uint64_t>(coords.x) & mask) << 42) |
+	       ((static_cast<uint64_t>(coords.y) & mask) << 21) |
+	       (static_cast<uint64_t>(coords.z) & mask);
+}
+
+// Open-addressing hash map from packed chunk coordinates to arena handles,
+// using linear probing and backward-shift deletion.
+class chunk_map {
+    public:
+	struct slot {
+		uint64_t key;
+		chunk_arena::handle handle;
+	};
+
+	chunk_map();
+	~chunk_map() = default;
+
+	inline chunk_arena::handle find(uint64_t key) const noexcept
+	{
+		uint32_t idx = hash(key) & m_mask;
+		while (m_slots[idx].handle != 0) {
+			if (m_slots[idx].key == key) {
+				return m_slots[idx].handle;
+			}
+
+			idx = (idx + 1) & m_mask;
+		}
+
+		return 0;
+	}
+
+	void insert(uint64_t key, chunk_arena::handle handle);
+	chunk_arena::handle erase(uint64_t key);
+
+	inline uint32_t size() const noexcept
+	{
+		return m_size;
+	}
+
+	template <typename fn> void for_each(fn &&f) const
+	{
+		for (const slot &s : m_slots) {
+			if (s.handle != 0) {
+				f(s.key, s.handle);
+			}
+		}
+	}
+
+    private:
+	static inline uint32_t hash(uint64_t key) noexcept
+	{
+		key ^= key >> 33;
+		key *= 0xff51afd7ed558ccdull;
+		key ^= key >> 33;
+		key *= 0xc4ceb9fe1a85ec53ull;
+		key ^= key >> 33;
+		return static_cast<uint32_t>(key);
+	}
+
+	void rehash(uint32_t capacity);
+
+    private:
+	std::vector<slot> m_slots;
+	uint32_t m_mask;
+	uint32_t m_size;
+};
+
+class world_snapshot;
+
+// Loaded chunks, addressed by chunk coordinates. Each chunk is linked to
+// its 26 loaded neighbours and exchanges halos with them when it is loaded;
+// after that chunk::set() keeps the halos in sync. Block accessors take world
+// block coordinates and remember the last chunk they hit, so spatially
+// coherent queries skip the hash lookup. That cache makes the accessors
+// unsafe to call concurrently.
+//
+// Chunks left untouched for a while are compressed in the background by
+// update_cold_tier() and transparently decompressed on their next access.
+//
+// Other threads read the world through snapshots. Taking one starts a new
+// epoch, and chunks from an earlier epoch are copied the first time they are
+// modified, so snapshots never see a write. Modify chunks only through
+// world_state while snapshots may be alive. Old versions are freed by
+// reclaim() once no snapshot can see them.
+class world_state {
+    public:
+	world_state();
+	~world_state();
+
+	chunk *load_chunk(const glm::ivec3 &coords, block_id fill = 0);
+	void unload_chunk(const glm::ivec3 &coords);
+
+	// The returned chunk must not be modified; see get_writable_chunk()
+	inline chunk *get_chunk(const glm::ivec3 &coords) const noexcept
+	{
+		chunk_arena::handle handle = m_chunks.find(pack_coords(coords));
+		if (handle == 0) {
+			return nullptr;
+		}
+
+		chunk *ch = m_arena.get(handle);
+		ch->touch();
+		return ch;
+	}
+
+	// Copies the chunk and its neighbours, which a chunk::set() may write
+	// into, if a snapshot may see them.
+	chunk *get_writable_chunk(const glm::ivec3 &coords);
+
+	// Decompresses the chunk if it is cold, so it may allocate
+	block_id get_block(const glm::ivec3 &pos) const;
+	void set_block(const glm::ivec3 &pos, block_id block);
+
+	// Captures the current chunks. Must be called from the thread owning
+	// the world; the snapshot itself may be used and released anywhere,
+	// but not after the world is destroyed.
+	std::shared_ptr<world_snapshot> snapshot();
+
+	// Frees chunk versions that no live snapshot can see
+	void reclaim();
+
+	// Advances the access clock, installs finished compressions and queues
+	// chunks that have gone cold. Meant to be called periodically from the
+	// thread owning the world.
+	void update_cold_tier();
+
+	inline uint32_t size() const noexcept
+	{
+		return m_chunks.size();
+	}
+
+	// Replaced chunk versions waiting for reclaim()
+	inline size_t get_retired() const noexcept
+	{
+		return m_retired.size();
+	}
+
+	template <typename fn> void for_each_chunk(fn &&f) const
+	{
+		m_chunks.for_each([&](uint64_t key, chunk_arena::handle h) {
+			f(unpack_coords(key), m_arena.get(h));
+		});
+	}
+
+	static inline glm::ivec3 chunk_coords(const glm::ivec3 &pos) noexcept
+	{
+		return pos >> CHUNK_SIZE_LOG;
+	}
+
+	static inline glm::ivec3 local_coords(const glm::ivec3 &pos) noexcept
+	{
+		return (pos & (CHUNK_SIZE - 1)) + CHUNK_BEGIN;
+	}
+
+    private:
+	template <typename fn> static void for_each_neighbour(fn &&f)
+	{
+		for (int dx = -1; dx <= 1; dx++) {
+			for (int dy = -1; dy <= 1; dy++) {
+				for (int dz = -1; dz <= 1; dz++) {
+					if (dx != 0 || dy != 0 || dz != 0) {
+						f(dx, dy, dz);
+					}
+				}
+			}
+		}
+	}
+
+	void link_neighbours(const glm::ivec3 &coords, chunk *ch);
+
+	// Returns the chunk at key, first replacing it by a copy if it belongs
+	// to an epoch a snapshot may see.
+	chunk *make_writable(uint64_t key);
+	void retire(chunk_arena::handle handle);
+
+	friend class world_snapshot;
+	void unpin(uint64_t epoch);
+
+	static glm::ivec3 unpack_coords(uint64_t key) noexcept;
+
+	chunk *find_cached(const glm::ivec3 &coords) const noexcept;
+
+    private:
+	chunk_arena m_arena;
+	chunk_map m_chunks;
+
+	// Compressions in flight, by chunk key
+	cold_tier m_cold_tier;
+	std::unordered_map<uint64_t, uint64_t> m_cold_pending;
+	uint64_t m_cold_next;
+
+	// Replaced versions, in the order they were retired, tagged with the
+	// epoch they were retired in.
+	struct retired_chunk {
+		chunk_arena::handle handle;
+		uint64_t epoch;
+	};
+
+	uint64_t m_epoch;
+	std::vector<retired_chunk> m_retired;
+
+	// Live snapshot count per epoch
+	std::mutex m_pin_mutex;
+	std::map<uint64_t, uint32_t> m_pins;
+
+	mutable glm::ivec3 m_last_coords;
+	mutable chunk *m_last;
+};
+
+// Immutable view of the chunks loaded when it was taken. Lookups take no
+// locks. Neighbour links of the chunks follow the live world and must not
+// be used through a snapshot.
+class world_snapshot {
+    public:
+	~world_snapshot();
+
+	world_snapshot(const world_snapshot &) = delete;
+	world_snapshot &operator=(const world_snapshot &) = delete;
+
+	const chunk *get_chunk(const glm::ivec3 &coords) const noexcept;
+
+	// Decompresses the chunk if it is cold, like world_state::get_block()
+	block_id get_block(const glm::ivec3 &pos) const;
+
+	inline uint64_t get_epoch() const noexcept
+	{
+		return m_epoch;
+	}
+
+	inline uint32_t size() const noexcept
+	{
+		return m_chunks.size();
+	}
+
+	template <typename fn> void for_each_chunk(fn &&f) const
+	{
+		for (const auto &[key, ch] : m_chunks) {
+			f(world_state::unpack_coords(key), ch);
+		}
+	}
+
+    private:
+	friend class world_state;
+	world_snapshot(world_state *world, uint64_t epoch);
+
+    private:
+	world_state *m_world;
+	uint64_t m_epoch;
+
+	// Sorted by key
+	std::vector<std::pair<uint64_t, const chunk *> > m_chunks;
 };
 }
 }
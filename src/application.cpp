@@ -70,6 +70,8 @@ void application::run()
 	m_render_thread = std::make_unique<render_thread>();
 	m_render_thread->init(m_window.get(), [&] { render(); });
 
+	m_executor = std::make_unique<tf::Executor>();
+
 	init();
 
 	m_state.input.set_framebuffer(wnd_size);
@@ -88,7 +90,6 @@ void application::run()
 	std::condition_variable cv;
 
 	tf::Taskflow taskflow;
-	tf::Executor executor;
 
 	auto start_pipe = [&](tf::Pipeflow &pf) {
 		{
@@ -134,7 +135,7 @@ void application::run()
 	tf::Task pipeline_task =
 		taskflow.composed_of(pipeline).name("App Frames");
 
-	tf::Future<void> done = executor.run(taskflow);
+	tf::Future<void> done = m_executor->run(taskflow);
 
 	m_render_thread->start();
 
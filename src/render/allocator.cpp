@@ -0,0 +1,243 @@
+#include "mineclonelib/render/allocator.h"
+
+#include <bit>
+#include <cassert>
+
+namespace mc
+{
+namespace render
+{
+range_allocator::range_allocator()
+	: m_bins{}
+	, m_top_mask(0)
+	, m_sub_masks{}
+	, m_tail(0)
+	, m_space(0)
+	, m_used(0)
+{
+}
+
+uint32_t range_allocator::get_bin(uint32_t size, bool round_up) noexcept
+{
+	if (size < RANGE_BIN_SUB) {
+		return size;
+	}
+
+	// Like a float with a 3-bit mantissa
+	uint32_t shift = std::bit_width(size) - 4;
+	uint32_t bin = (shift + 1) * RANGE_BIN_SUB +
+		       ((size >> shift) & (RANGE_BIN_SUB - 1));
+
+	if (round_up && (size & ((1u << shift) - 1)) != 0) {
+		bin++;
+	}
+
+	return bin;
+}
+
+range_allocator::handle range_allocator::new_node(uint32_t offset,
+						  uint32_t size)
+{
+	handle h;
+	if (!m_free_nodes.empty()) {
+		h = m_free_nodes.back();
+		m_free_nodes.pop_back();
+	} else {
+		m_nodes.emplace_back();
+		h = m_nodes.size();
+	}
+
+	m_nodes[h - 1] = { offset, size, 0, 0, 0, 0, false };
+	return h;
+}
+
+void range_allocator::delete_node(handle h)
+{
+	m_free_nodes.push_back(h);
+}
+
+void range_allocator::insert_free(handle h)
+{
+	node &n = m_nodes[h - 1];
+	uint32_t bin = get_bin(n.size, false);
+
+	n.used = false;
+	n.bin_prev = 0;
+	n.bin_next = m_bins[bin];
+
+	if (n.bin_next != 0) {
+		m_nodes[n.bin_next - 1].bin_prev = h;
+	}
+
+	m_bins[bin] = h;
+	m_sub_masks[bin / RANGE_BIN_SUB] |= 1 << (bin % RANGE_BIN_SUB);
+	m_top_mask |= 1u << (bin / RANGE_BIN_SUB);
+}
+
+void range_allocator::remove_free(handle h)
+{
+	node &n = m_nodes[h - 1];
+
+	if (n.bin_next != 0) {
+		m_nodes[n.bin_next - 1].bin_prev = n.bin_prev;
+	}
+
+	if (n.bin_prev != 0) {
+		m_nodes[n.bin_prev - 1].bin_next = n.bin_next;
+		return;
+	}
+
+	uint32_t bin = get_bin(n.size, false);
+	m_bins[bin] = n.bin_next;
+
+	if (m_bins[bin] == 0) {
+		uint32_t top = bin / RANGE_BIN_SUB;
+
+		m_sub_masks[top] &= ~(1 << (bin % RANGE_BIN_SUB));
+		if (m_sub_masks[top] == 0) {
+			m_top_mask &= ~(1u << top);
+		}
+	}
+}
+
+uint32_t range_allocator::find_bin(uint32_t bin) const noexcept
+{
+	uint32_t top = bin / RANGE_BIN_SUB;
+	if (top >= RANGE_BIN_TOP) {
+		return RANGE_BIN_COUNT;
+	}
+
+	uint32_t sub = m_sub_masks[top] & (0xffu << (bin % RANGE_BIN_SUB));
+	if (sub != 0) {
+		return top * RANGE_BIN_SUB + std::countr_zero(sub);
+	}
+
+	// Shifting by 32 is undefined, hence the two steps
+	uint32_t above = m_top_mask & ((~0u << top) << 1);
+	if (above == 0) {
+		return RANGE_BIN_COUNT;
+	}
+
+	top = std::countr_zero(above);
+	return top * RANGE_BIN_SUB + std::countr_zero(m_sub_masks[top]);
+}
+
+range_allocator::handle range_allocator::allocate(uint32_t size)
+{
+	assert(size != 0);
+
+	uint32_t bin = find_bin(get_bin(size, true));
+	if (bin == RANGE_BIN_COUNT) {
+		return 0;
+	}
+
+	handle h = m_bins[bin];
+	remove_free(h);
+
+	node &n = m_nodes[h - 1];
+	n.used = true;
+	m_used += size;
+
+	if (n.size == size) {
+		return h;
+	}
+
+	// The rest of the range goes back as a free range after it
+	handle rest = new_node(n.offset + size, n.size - size);
+
+	// new_node() may have moved the nodes
+	node &used = m_nodes[h - 1];
+	node &r = m_nodes[rest - 1];
+
+	used.size = size;
+	r.prev = h;
+	r.next = used.next;
+	used.next = rest;
+
+	if (r.next != 0) {
+		m_nodes[r.next - 1].prev = rest;
+	} else {
+		m_tail = rest;
+	}
+
+	insert_free(rest);
+	return h;
+}
+
+void range_allocator::free(handle h)
+{
+	node &n = m_nodes[h - 1];
+	assert(n.used);
+
+	m_used -= n.size;
+
+	if (n.prev != 0 && !m_nodes[n.prev - 1].used) {
+		handle prev = n.prev;
+		node &p = m_nodes[prev - 1];
+		remove_free(prev);
+
+		n.offset = p.offset;
+		n.size += p.size;
+		n.prev = p.prev;
+
+		if (n.prev != 0) {
+			m_nodes[n.prev - 1].next = h;
+		}
+
+		delete_node(prev);
+	}
+
+	if (n.next != 0 && !m_nodes[n.next - 1].used) {
+		handle next = n.next;
+		node &x = m_nodes[next - 1];
+		remove_free(next);
+
+		n.size += x.size;
+		n.next = x.next;
+
+		if (n.next != 0) {
+			m_nodes[n.next - 1].prev = h;
+		} else {
+			m_tail = h;
+		}
+
+		delete_node(next);
+	}
+
+	insert_free(h);
+}
+
+void range_allocator::grow(uint32_t size)
+{
+	uint32_t offset = m_space;
+	m_space += size;
+
+	if (m_tail != 0 && !m_nodes[m_tail - 1].used) {
+		remove_free(m_tail);
+		m_nodes[m_tail - 1].size += size;
+		insert_free(m_tail);
+		return;
+	}
+
+	handle h = new_node(offset, size);
+	m_nodes[h - 1].prev = m_tail;
+
+	if (m_tail != 0) {
+		m_nodes[m_tail - 1].next = h;
+	}
+
+	m_tail = h;
+	insert_free(h);
+}
+
+range_allocator::handle range_allocator::get_last() const
+{
+	handle h = m_tail;
+	while (h != 0 && !m_nodes[h - 1].used) {
+		h = m_nodes[h - 1].prev;
+	}
+
+	return h;
+}
+}
+}
@@ -0,0 +1,129 @@
+#include "mineclonelib/render/gl/staging.h"
+
+#include <cstring>
+
+namespace mc
+{
+namespace render
+{
+namespace gl
+{
+staging_ring::staging_ring(size_t size)
+	: m_buffer(0)
+	, m_data(nullptr)
+	, m_size((size + 15) & ~size_t(15))
+	, m_head(0)
+	, m_tail(0)
+{
+	// Coherent, so writes through the mapping are seen by copies issued
+	// after them without flushing ranges
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+				 GL_MAP_COHERENT_BIT;
+
+	glCreateBuffers(1, &m_buffer);
+	glNamedBufferStorage(m_buffer, m_size, NULL, flags);
+
+	m_data = static_cast<uint8_t *>(
+		glMapNamedBufferRange(m_buffer, 0, m_size, flags));
+}
+
+staging_ring::~staging_ring()
+{
+	for (const batch &b : m_batches) {
+		glDeleteSync(b.fence);
+	}
+
+	glUnmapNamedBuffer(m_buffer);
+	glDeleteBuffers(1, &m_buffer);
+}
+
+void *staging_ring::stage(GLuint buffer, size_t offset, size_t size)
+{
+	size_t aligned = (size + 15) & ~size_t(15);
+	if (aligned > m_size) {
+		return nullptr;
+	}
+
+	// Copies read one run of the ring, so one that would wrap starts over
+	// at its beginning
+	uint64_t start = m_head;
+	if (start % m_size + aligned > m_size) {
+		start += m_size - start % m_size;
+	}
+
+	while (start + aligned - m_tail > m_size) {
+		if (!m_copies.empty()) {
+			flush();
+		}
+
+		if (m_batches.empty()) {
+			m_tail = start;
+			break;
+		}
+
+		retire(GL_TIMEOUT_IGNORED);
+	}
+
+	m_head = start + aligned;
+	m_copies.push_back({ buffer, size_t(start % m_size), offset, size });
+
+	return m_data + start % m_size;
+}
+
+void staging_ring::write(GLuint buffer, size_t offset, size_t size,
+			 const void *data)
+{
+	if (size == 0) {
+		return;
+	}
+
+	void *dst = stage(buffer, offset, size);
+	if (dst == nullptr) {
+		// After the copies staged before it, as it would have been
+		flush();
+		glNamedBufferSubData(buffer, offset, size, data);
+		return;
+	}
+
+	std::memcpy(dst, data, size);
+}
+
+void staging_ring::flush()
+{
+	if (m_copies.empty()) {
+		return;
+	}
+
+	for (const copy &c : m_copies) {
+		glCopyNamedBufferSubData(m_buffer, c.buffer, c.src, c.dst,
+					 c.size);
+	}
+
+	m_copies.clear();
+	m_batches.push_back(
+		{ m_head, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) });
+
+	// Releases the batches that are done, without waiting on any
+	while (!m_batches.empty() && retire(0)) {
+	}
+}
+
+bool staging_ring::retire(GLuint64 timeout)
+{
+	const batch &b = m_batches.front();
+
+	GLenum status = glClientWaitSync(b.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+					 timeout);
+	if (status == GL_TIMEOUT_EXPIRED) {
+		return false;
+	}
+
+	glDeleteSync(b.fence);
+	m_tail = b.end;
+	m_batches.pop_front();
+
+	return true;
+}
+}
+}
+}
@@ -24,13 +24,21 @@ static std::string read_file(const char *path)
 	return ss.str();
 }
 
-GLuint load_shader(const char *path, GLenum type)
+GLuint load_shader(const char *path, GLenum type, const char *defines)
 {
 	std::string src = read_file(path);
 	if (src.empty()) {
 		return 0;
 	}
 
+	if (defines != nullptr) {
+		size_t version = src.find("#version");
+		size_t line = (version == std::string::npos ?
+				       0 :
+				       src.find('\n', version) + 1);
+		src.insert(line, defines);
+	}
+
 	const GLchar *c_src = src.c_str();
 
 	GLuint shader = glCreateShader(type);
@@ -1,59 +1,54 @@
 #include "mineclonelib/render/gl/world.h"
 #include "mineclonelib/render/gl/utils.h"
 #include "mineclonelib/render/world.h"
+#include "mineclonelib/world/arena.h"
 #include "mineclonelib/world/blocks.h"
 #include "mineclonelib/world/chunk.h"
 #include "mineclonelib/io/assets.h"
+#include "mineclonelib/cvar.h"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 #include <stb_image.h>
 
-#define CHUNK_MESH_SIZE (CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE * 3)
+#include <algorithm>
+#include <string>
 
-namespace mc
-{
-namespace render
-{
-struct packed_face {
-	uint32_t geometry;
-	uint32_t shading;
-};
+// Room for each normal of a mesh built by the meshing shader, enough for any
+// chunk
+#define CHUNK_NORMAL_SIZE (CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE / 2)
 
-static packed_face pack_face(const mc::world::face_draw_data &face)
-{
-	uint32_t geometry =
-		(static_cast<uint32_t>(face.x)) |
-		(static_cast<uint32_t>(face.y) << (CHUNK_SIZE_LOG)) |
-		(static_cast<uint32_t>(face.z) << (2 * CHUNK_SIZE_LOG)) |
-		(static_cast<uint32_t>(face.ao) << (3 * CHUNK_SIZE_LOG));
+static mc::cvar<uint32_t>
+	mesh_slack(64, "render/mesh_slack",
+		   "Spare faces after each normal of a chunk mesh for patches");
 
-	uint32_t shading = face.face;
+static mc::cvar<uint32_t>
+	mesh_page(64, "render/mesh_page",
+		  "Size in MiB of the pages of chunk faces, which are added as "
+		  "needed");
 
-	return { geometry, shading };
-}
+static mc::cvar<uint32_t>
+	staging_size(16, "render/staging_size",
+		     "Size in MiB of the ring chunk uploads are staged in");
 
-struct chunk_uniform_data {
-	glm::mat4 model;
-	uint32_t normal;
-	uint32_t padding[3];
-};
+static mc::cvar<uint32_t>
+	compact_rate(1 << 20, "render/compact_rate",
+		     "Bytes of chunk faces moved a frame to defragment their "
+		     "pages");
 
-struct indirect_draw_command {
-	unsigned int count;
-	unsigned int instance_count;
-	unsigned int first_vertex;
-	unsigned int base_instance;
-};
+static mc::cvar<bool>
+	gpu_meshing(false, "render/gpu_meshing",
+		    "Whether to mesh chunks in a compute shader instead of on "
+		    "the CPU");
 
-static void gl_write_zeros(GLuint buffer, uint32_t offset, uint32_t size)
+namespace mc
 {
-	std::vector<uint8_t> zeros(size, 0);
-	glNamedBufferSubData(buffer, offset, size, zeros.data());
-}
+namespace render
+{
+using world::packed_face;
 
-static GLuint gl_grow_buffer(GLuint buffer, uint32_t prev, uint32_t next)
+static GLuint gl_grow_buffer(GLuint buffer, size_t prev, size_t next)
 {
 	GLuint new_buffer;
 	glCreateBuffers(1, &new_buffer);
@@ -67,18 +62,62 @@ static GLuint gl_grow_buffer(GLuint buffer, uint32_t prev, uint32_t next)
 	return new_buffer;
 }
 
+// The blocks of a chunk for the meshing shader are staged whole
+static size_t get_staging_size()
+{
+	using dims = world::chunk_dims<CHUNK_SIZE_LOG>;
+
+	size_t voxels = dims::total * dims::total * dims::total *
+			sizeof(world::block_id);
+	return std::max<size_t>(staging_size.get() * (size_t(1) << 20),
+				voxels);
+}
+
 gl_world_renderer::gl_world_renderer(context *ctx)
 	: world_renderer(ctx)
-	, m_chunks(0)
-	, m_uniforms(0)
+	, m_dirty(true)
+	, m_page_size(0)
+	, m_staging(get_staging_size())
+	, m_instances(0)
 	, m_indirect(0)
+	, m_mesh_info(0)
 	, m_capacity(0)
+	, m_instance_capacity(0)
+	, m_quad_indices(0)
+	, m_vao(0)
+	, m_mesh_program(0)
+	, m_mesh_slot(-1)
+	, m_mesh_offsets(-1)
+	, m_voxels(0)
+	, m_blocks(0)
+	, m_ao(0)
+	, m_counts(0)
 {
 	grow(9);
 
+	// A page must hold the ranges the meshing shader takes for a chunk,
+	// and is bound whole. Offsets of compact faces count words, and base
+	// vertices four times that, which must fit a GLint.
+	GLint64 max_block = 0;
+	glGetInteger64v(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &max_block);
+
+	size_t page = mesh_page.get() * (size_t(1) << 20) / sizeof(packed_face);
+	page = std::max<size_t>(page, 8 * CHUNK_NORMAL_SIZE);
+	page = std::min<size_t>(page, max_block / sizeof(packed_face));
+	m_page_size = std::min<size_t>(page, INT32_MAX / 8);
+
+	create_quad_indices();
+
+	if (gpu_meshing.get()) {
+		create_mesh_program();
+	}
+
+	const std::string defines = "#define CHUNK_SIZE_LOG " +
+				    std::to_string(CHUNK_SIZE_LOG) + "\n";
+
 	GLuint vertex_shader =
 		gl::load_shader(ASSET_PATH("mineclone/shaders/gl/chunk.vert"),
-				GL_VERTEX_SHADER);
+				GL_VERTEX_SHADER, defines.c_str());
 
 	GLuint fragment_shader =
 		gl::load_shader(ASSET_PATH("mineclone/shaders/gl/chunk.frag"),
@@ -88,8 +127,9 @@ gl_world_renderer::gl_world_renderer(context *ctx)
 
 	glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &m_texarray);
 
-	glTextureParameteri(m_texarray, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTextureParameteri(m_texarray, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	// Merged quads tile the texture once per block
+	glTextureParameteri(m_texarray, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTextureParameteri(m_texarray, GL_TEXTURE_WRAP_T, GL_REPEAT);
 	glTextureParameteri(m_texarray, GL_TEXTURE_MIN_FILTER,
 			    GL_NEAREST_MIPMAP_LINEAR);
 	glTextureParameteri(m_texarray, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -116,6 +156,11 @@ gl_world_renderer::gl_world_renderer(context *ctx)
 		int width, height, channels;
 		unsigned char *data =
 			stbi_load(path, &width, &height, &channels, 0);
+		if (data == nullptr) {
+			LOG_ERROR(Render, "Failed to load texture {}: {}", path,
+				  stbi_failure_reason());
+			continue;
+		}
 
 		glTextureSubImage3D(m_texarray, 0, 0, 0, i, width, height, 1,
 				    channels == 3 ? GL_RGB : GL_RGBA,
@@ -147,6 +192,7 @@ gl_world_renderer::gl_world_renderer(context *ctx)
 	m_view = glGetUniformLocation(m_program, "u_view");
 	m_projection = glGetUniformLocation(m_program, "u_projection");
 	m_texture = glGetUniformLocation(m_program, "u_texture");
+	m_first_mesh = glGetUniformLocation(m_program, "u_first_mesh");
 }
 
 gl_world_renderer::~gl_world_renderer()
@@ -159,93 +205,907 @@ gl_world_renderer::~gl_world_renderer()
 		glDeleteTextures(1, &m_texarray);
 	}
 
-	if (m_chunks) {
-		glDeleteBuffers(1, &m_chunks);
+	for (const std::unique_ptr<face_page> &page : m_pages) {
+		glDeleteBuffers(1, &page->buffer);
 	}
 
-	if (m_uniforms) {
-		glDeleteBuffers(1, &m_uniforms);
+	if (m_instances) {
+		glDeleteBuffers(1, &m_instances);
 	}
 
 	if (m_indirect) {
 		glDeleteBuffers(1, &m_indirect);
 	}
+
+	if (m_mesh_info) {
+		glDeleteBuffers(1, &m_mesh_info);
+	}
+
+	if (m_quad_indices) {
+		glDeleteBuffers(1, &m_quad_indices);
+	}
+
+	if (m_vao) {
+		glDeleteVertexArrays(1, &m_vao);
+	}
+
+	for (const gpu_mesh &m : m_gpu_meshes) {
+		glDeleteSync(m.fence);
+	}
+
+	if (m_mesh_program) {
+		glDeleteProgram(m_mesh_program);
+	}
+
+	const GLuint buffers[] = { m_voxels, m_blocks, m_ao, m_counts };
+	for (GLuint buffer : buffers) {
+		if (buffer) {
+			glDeleteBuffers(1, &buffer);
+		}
+	}
+}
+
+void gl_world_renderer::create_quad_indices()
+{
+	// Enough for the most faces one normal of a mesh can have
+	const uint32_t quads = CHUNK_NORMAL_SIZE;
+	const uint32_t pattern[] = { 0, 1, 2, 2, 3, 0 };
+
+	mc::world::scratch_scope scratch;
+
+	uint32_t *indices = scratch.allocate<uint32_t>(quads * 6);
+	for (uint32_t i = 0; i < quads; i++) {
+		for (uint32_t j = 0; j < 6; j++) {
+			indices[i * 6 + j] = i * 4 + pattern[j];
+		}
+	}
+
+	glCreateBuffers(1, &m_quad_indices);
+	glNamedBufferStorage(m_quad_indices, quads * 6 * sizeof(uint32_t),
+			     indices, 0);
+
+	// Faces are pulled from storage buffers, so the vertex array only
+	// holds the indices
+	glCreateVertexArrays(1, &m_vao);
+	glVertexArrayElementBuffer(m_vao, m_quad_indices);
+}
+
+namespace gl
+{
+void create_mesh_tables(GLuint &blocks, GLuint &ao)
+{
+	const world::block_properties *props = world::blocks::get_properties();
+
+	// Face ids two to a word, then the flags, as chunk_mesh.comp reads them
+	std::vector<uint32_t> table(props->size() * 4);
+	for (uint32_t b = 0; b < props->size(); b++) {
+		for (uint32_t k = 0; k < 6; k++) {
+			world::face_id face = props->get_face(
+				b, static_cast<world::block_face>(k));
+			table[b * 4 + k / 2] |= static_cast<uint32_t>(face)
+						<< (k % 2 * 16);
+		}
+
+		table[b * 4 + 3] = props->get_renderable_faces(b) |
+				   props->is_opaque(b) << 6;
+	}
+
+	uint32_t levels[512];
+	for (uint32_t mask = 0; mask < 512; mask++) {
+		levels[mask] = world::get_face_ao(mask);
+	}
+
+	glCreateBuffers(1, &blocks);
+	glNamedBufferStorage(blocks, table.size() * sizeof(uint32_t),
+			     table.data(), 0);
+
+	glCreateBuffers(1, &ao);
+	glNamedBufferStorage(ao, sizeof(levels), levels, 0);
+}
+}
+
+void gl_world_renderer::create_mesh_program()
+{
+	using dims = world::chunk_dims<CHUNK_SIZE_LOG>;
+
+	const std::string defines = "#define CHUNK_SIZE_LOG " +
+				    std::to_string(CHUNK_SIZE_LOG) + "\n";
+
+	GLuint shader = gl::load_shader(
+		ASSET_PATH("mineclone/shaders/gl/chunk_mesh.comp"),
+		GL_COMPUTE_SHADER, defines.c_str());
+	if (shader == 0) {
+		LOG_ERROR(Render, "Falling back to meshing chunks on the CPU");
+		return;
+	}
+
+	m_mesh_program = glCreateProgram();
+	glAttachShader(m_mesh_program, shader);
+	glLinkProgram(m_mesh_program);
+	glDetachShader(m_mesh_program, shader);
+	glDeleteShader(shader);
+
+	if (!gl::check_link_status(m_mesh_program)) {
+		glDeleteProgram(m_mesh_program);
+		m_mesh_program = 0;
+
+		LOG_ERROR(Render, "Falling back to meshing chunks on the CPU");
+		return;
+	}
+
+	m_mesh_slot = glGetUniformLocation(m_mesh_program, "u_slot");
+	m_mesh_offsets = glGetUniformLocation(m_mesh_program, "u_offsets");
+
+	gl::create_mesh_tables(m_blocks, m_ao);
+
+	// One chunk at a time, rounded up to whole words
+	size_t voxels = dims::total * dims::total * dims::total;
+	glCreateBuffers(1, &m_voxels);
+	glNamedBufferStorage(m_voxels, (voxels + 1) / 2 * sizeof(uint32_t),
+			     NULL, GL_DYNAMIC_STORAGE_BIT);
+
+	LOG_INFO(Render, "Meshing chunks in a compute shader");
 }
 
 chunk_handle gl_world_renderer::alloc_chunk()
+{
+	if (!m_free_chunks.empty()) {
+		chunk_handle handle = m_free_chunks.back();
+		m_free_chunks.pop_back();
+		return handle;
+	}
+
+	m_chunk_slots.push_back({ 0, glm::mat4(1.0f) });
+	return m_chunk_slots.size();
+}
+
+void gl_world_renderer::free_chunk(chunk_handle handle)
+{
+	detach_chunk(handle);
+	m_free_chunks.push_back(handle);
+}
+
+void gl_world_renderer::upload_chunk(chunk_handle handle, uint64_t hash,
+				     const mc::world::chunk_mesh *mesh,
+				     const glm::mat4 &model)
+{
+	chunk_slot &slot = m_chunk_slots[handle - 1];
+	slot.model = model;
+	m_dirty = true;
+
+	if (slot.mesh != 0 && holds(slot.mesh, hash, mesh->content)) {
+		return;
+	}
+
+	detach_chunk(handle);
+
+	uint32_t idx = find_or_upload_mesh(hash, mesh);
+	if (idx != 0) {
+		attach_chunk(handle, idx);
+	}
+}
+
+uint32_t
+gl_world_renderer::find_or_upload_mesh(uint64_t hash,
+				       const mc::world::chunk_mesh *mesh)
+{
+	uint32_t idx = find_mesh(hash, mesh->content);
+	if (idx != 0) {
+		return idx;
+	}
+
+	if (mesh->faces.empty()) {
+		return 0;
+	}
+
+	idx = alloc_mesh();
+	write_mesh(idx, mesh);
+
+	m_meshes[idx - 1].hash = hash;
+	m_meshes[idx - 1].content = mesh->content;
+	cache_mesh(idx);
+	return idx;
+}
+
+bool gl_world_renderer::holds(uint32_t idx, uint64_t hash,
+			      const std::vector<uint8_t> &content) const
+{
+	const mesh_slot &ms = m_meshes[idx - 1];
+	return ms.hash == hash && !content.empty() && ms.content == content;
+}
+
+uint32_t gl_world_renderer::find_mesh(uint64_t hash,
+				      const std::vector<uint8_t> &content) const
+{
+	auto it = m_mesh_cache.find(hash);
+	if (it == m_mesh_cache.end() || !holds(it->second, hash, content)) {
+		return 0;
+	}
+
+	return it->second;
+}
+
+void gl_world_renderer::cache_mesh(uint32_t idx)
+{
+	// A mesh colliding with a cached one stays private to its chunks
+	const mesh_slot &ms = m_meshes[idx - 1];
+	if (!ms.content.empty()) {
+		m_mesh_cache.try_emplace(ms.hash, idx);
+	}
+}
+
+void gl_world_renderer::uncache_mesh(uint32_t idx)
+{
+	auto it = m_mesh_cache.find(m_meshes[idx - 1].hash);
+	if (it != m_mesh_cache.end() && it->second == idx) {
+		m_mesh_cache.erase(it);
+	}
+}
+
+uint32_t gl_world_renderer::alloc_mesh()
 {
 	if (m_free.empty()) {
 		grow(m_capacity * 1.5);
 	}
 
-	chunk_handle handle = m_free.top();
+	uint32_t idx = m_free.top();
 	m_free.pop();
 
-	return handle;
+	return idx;
 }
 
-void gl_world_renderer::free_chunk(chunk_handle handle)
+bool gl_world_renderer::meshes_voxels() const
 {
-	gl_write_zeros(m_indirect,
-		       (handle - 1) * 6 * sizeof(indirect_draw_command),
-		       6 * sizeof(indirect_draw_command));
-	m_free.push(handle);
+	return m_mesh_program != 0;
 }
 
-void gl_world_renderer::upload_chunk(chunk_handle handle,
-				     mc::world::chunk_draw_data *draw_data,
-				     const glm::mat4 &model)
+void gl_world_renderer::upload_voxels(chunk_handle handle, uint64_t hash,
+				      const mc::world::chunk *ch,
+				      const glm::mat4 &model)
+{
+	using dims = world::chunk_dims<CHUNK_SIZE_LOG>;
+
+	chunk_slot &slot = m_chunk_slots[handle - 1];
+	slot.model = model;
+	m_dirty = true;
+
+	m_content.clear();
+	ch->encode_content(m_content);
+
+	if (slot.mesh != 0 && holds(slot.mesh, hash, m_content)) {
+		return;
+	}
+
+	detach_chunk(handle);
+
+	uint32_t cached = find_mesh(hash, m_content);
+	if (cached != 0) {
+		attach_chunk(handle, cached);
+		return;
+	}
+
+	// Every face of a uniform chunk has the same block on both sides
+	if (ch->is_uniform()) {
+		return;
+	}
+
+	uint32_t idx = alloc_mesh();
+
+	// Counts stay zero until read back, while the draw commands take
+	// theirs from the GPU. The ranges fit any chunk until then.
+	mesh_slot &mesh = m_meshes[idx - 1];
+	mesh.hash = hash;
+	mesh.content = m_content;
+	mesh.wide = true;
+
+	const uint32_t faces[6] = { CHUNK_NORMAL_SIZE, CHUNK_NORMAL_SIZE,
+				    CHUNK_NORMAL_SIZE, CHUNK_NORMAL_SIZE,
+				    CHUNK_NORMAL_SIZE, CHUNK_NORMAL_SIZE };
+	if (!alloc_ranges(idx, faces, false)) {
+		// Ranges sized for any chunk are large, so those of the chunks
+		// meshed before are shrunk first rather than adding a page
+		std::erase_if(m_gpu_meshes, [&](const gpu_mesh &m) {
+			return read_gpu_counts(m, GL_TIMEOUT_IGNORED);
+		});
+
+		if (!alloc_ranges(idx, faces)) {
+			m_free.push(idx);
+			return;
+		}
+	}
+
+	for (uint32_t n = 0; n < 6; n++) {
+		mesh.counts[n] = 0;
+	}
+
+	write_info(idx, nullptr, 0);
+
+	cache_mesh(idx);
+	attach_chunk(handle, idx);
+
+	size_t count = dims::total * dims::total * dims::total;
+	void *dense = m_staging.stage(m_voxels, 0,
+				      count * sizeof(world::block_id));
+	ch->unpack(static_cast<world::block_id *>(dense));
+
+	// The shader reads the blocks, and writes ranges that staged writes
+	// from before they were freed may still target
+	m_staging.flush();
+
+	GLuint zero = 0;
+	glClearNamedBufferSubData(m_counts, GL_R32UI,
+				  (idx - 1) * 6 * sizeof(GLuint),
+				  6 * sizeof(GLuint), GL_RED_INTEGER,
+				  GL_UNSIGNED_INT, &zero);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1,
+			 m_pages[mesh.page]->buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_voxels);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, m_blocks);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, m_ao);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, m_counts);
+
+	glUseProgram(m_mesh_program);
+	glUniform1ui(m_mesh_slot, idx - 1);
+	glUniform1uiv(m_mesh_offsets, 6, mesh.offsets);
+	glDispatchCompute(dims::size / 4, dims::size / 4, dims::size / 4);
+
+	// The faces are pulled by the next draw, and the counts copied into
+	// its commands
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT |
+			GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	m_gpu_meshes.push_back(
+		{ idx, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) });
+}
+
+bool gl_world_renderer::read_gpu_counts(const gpu_mesh &m, GLuint64 timeout)
+{
+	GLenum status = glClientWaitSync(m.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+					 timeout);
+	if (status == GL_TIMEOUT_EXPIRED) {
+		return false;
+	}
+
+	// The counts may not have landed, so the mesh stays pending
+	if (status == GL_WAIT_FAILED) {
+		LOG_ERROR(Render, "Waiting for the GPU mesh of slot {} failed",
+			  m.mesh);
+		return false;
+	}
+
+	GLuint counts[6];
+	glGetNamedBufferSubData(m_counts, (m.mesh - 1) * sizeof(counts),
+				sizeof(counts), counts);
+
+	glDeleteSync(m.fence);
+
+	mesh_slot &mesh = m_meshes[m.mesh - 1];
+
+	uint32_t faces[6];
+	for (uint32_t n = 0; n < 6; n++) {
+		mesh.counts[n] = counts[n] / 6;
+		faces[n] = mesh.counts[n] + mesh_slack.get();
+	}
+
+	// Moves the faces out of the ranges sized for any chunk, possibly to
+	// another page
+	face_page *from = m_pages[mesh.page].get();
+	range_allocator::handle ranges[6];
+	uint32_t offsets[6];
+	std::copy_n(mesh.ranges, 6, ranges);
+	std::copy_n(mesh.offsets, 6, offsets);
+
+	if (alloc_ranges(m.mesh, faces)) {
+		// Staged writes to the new ranges would land after the faces
+		m_staging.flush();
+
+		GLuint to = m_pages[mesh.page]->buffer;
+		for (uint32_t n = 0; n < 6; n++) {
+			if (mesh.counts[n] != 0) {
+				glCopyNamedBufferSubData(
+					from->buffer, to,
+					offsets[n] * sizeof(packed_face),
+					mesh.offsets[n] * sizeof(packed_face),
+					mesh.counts[n] * sizeof(packed_face));
+			}
+
+			from->faces.free(ranges[n]);
+		}
+	}
+
+	update_commands(m.mesh);
+	return true;
+}
+
+void gl_world_renderer::forget_gpu_mesh(uint32_t mesh, bool wait)
+{
+	std::erase_if(m_gpu_meshes, [&](const gpu_mesh &m) {
+		if (m.mesh != mesh) {
+			return false;
+		}
+
+		if (!wait || !read_gpu_counts(m, GL_TIMEOUT_IGNORED)) {
+			glDeleteSync(m.fence);
+		}
+
+		return true;
+	});
+}
+
+void gl_world_renderer::patch_chunk(chunk_handle handle, uint64_t hash,
+				    const mc::world::chunk_mesh *mesh,
+				    uint8_t normals)
 {
-	std::vector<packed_face> faces[6];
+	chunk_slot &slot = m_chunk_slots[handle - 1];
 
-	for (uint32_t i = 0; i < draw_data->faces.size(); i++) {
-		world::block_face normal = draw_data->faces[i].normal;
-		packed_face face = pack_face(draw_data->faces[i]);
-		faces[static_cast<uint32_t>(normal)].push_back(face);
+	// Shared meshes are left to the other chunks using them
+	if (slot.mesh == 0 || m_meshes[slot.mesh - 1].chunks.size() > 1 ||
+	    find_mesh(hash, mesh->content) != 0) {
+		upload_chunk(handle, hash, mesh, slot.model);
+		return;
 	}
 
-	indirect_draw_command cmd = { .count = 0,
-				      .instance_count = 0,
-				      .first_vertex = 0,
-				      .base_instance = 0 };
+	// The faces of the normals left alone must be counted
+	forget_gpu_mesh(slot.mesh, true);
 
-	chunk_uniform_data uniforms;
-	uniforms.model = model;
+	mesh_slot &ms = m_meshes[slot.mesh - 1];
 
-	uint32_t fidx = (handle - 1) * CHUNK_MESH_SIZE;
-	uint32_t idx = (handle - 1) * 6;
+	// Compact meshes are relaid out, as the patch may not fit their
+	// texture table
+	bool fits = ms.wide;
+	for (uint32_t n = 0; n < 6; n++) {
+		if (mesh->counts[n] > ms.capacity[n]) {
+			fits = false;
+		}
+	}
+
+	if (fits) {
+		const packed_face *faces = mesh->faces.data();
+		for (uint32_t n = 0; n < 6; n++) {
+			if (normals & (1 << n)) {
+				write_faces(slot.mesh, n, faces,
+					    mesh->counts[n]);
+				ms.counts[n] = mesh->counts[n];
+			}
+
+			faces += mesh->counts[n];
+		}
+	} else {
+		write_mesh(slot.mesh, mesh);
+	}
+
+	// The content of a patched mesh is not known, so it is no longer
+	// shared with chunks uploaded later
+	uncache_mesh(slot.mesh);
+	ms.hash = hash;
+	ms.content.clear();
+
+	update_commands(slot.mesh);
+}
+
+void gl_world_renderer::write_mesh(uint32_t idx,
+				   const mc::world::chunk_mesh *mesh)
+{
+	mesh_slot &slot = m_meshes[idx - 1];
+
+	world::scratch_scope scratch;
+
+	uint32_t *compact = scratch.allocate<uint32_t>(mesh->faces.size());
+	world::face_id textures[COMPACT_TEXTURES];
+
+	uint32_t count = world::compact_faces<CHUNK_SIZE_LOG>(
+		mesh->faces.data(), mesh->faces.size(), compact, textures);
+
+	free_ranges(idx);
+
+	slot.wide = count == 0;
+	write_info(idx, textures, count);
+
+	const void *data = mesh->faces.data();
+	size_t stride = sizeof(packed_face);
+	if (!slot.wide) {
+		data = compact;
+		stride = sizeof(uint32_t);
+	}
+
+	uint32_t capacity[6];
+	for (uint32_t n = 0; n < 6; n++) {
+		capacity[n] = mesh->counts[n] + mesh_slack.get();
+		slot.counts[n] = 0;
+	}
+
+	if (!alloc_ranges(idx, capacity)) {
+		LOG_ERROR(Render, "Chunk mesh of {} faces does not fit a page",
+			  mesh->faces.size());
+		return;
+	}
+
+	const uint8_t *faces = static_cast<const uint8_t *>(data);
+
+	for (uint32_t n = 0; n < 6; n++) {
+		slot.counts[n] = mesh->counts[n];
+		write_faces(idx, n, faces, mesh->counts[n]);
+
+		faces += mesh->counts[n] * stride;
+	}
+}
+
+bool gl_world_renderer::alloc_ranges(uint32_t idx, const uint32_t faces[6],
+				     bool grow)
+{
+	// Two compact faces to a unit
+	uint32_t units[6];
+	for (uint32_t n = 0; n < 6; n++) {
+		units[n] = faces[n];
+		if (!m_meshes[idx - 1].wide) {
+			units[n] = (faces[n] + 1) / 2;
+		}
+	}
+
+	for (uint32_t page = 0; page < m_pages.size(); page++) {
+		if (alloc_ranges_in(idx, page, units)) {
+			return true;
+		}
+	}
+
+	if (!grow) {
+		return false;
+	}
+
+	add_page();
+	return alloc_ranges_in(idx, m_pages.size() - 1, units);
+}
+
+bool gl_world_renderer::alloc_ranges_in(uint32_t idx, uint32_t page,
+					const uint32_t units[6])
+{
+	face_page &p = *m_pages[page];
+
+	range_allocator::handle ranges[6] = {};
+	for (uint32_t n = 0; n < 6; n++) {
+		if (units[n] == 0) {
+			continue;
+		}
+
+		ranges[n] = p.faces.allocate(units[n]);
+		if (ranges[n] != 0) {
+			continue;
+		}
+
+		for (uint32_t i = 0; i < n; i++) {
+			if (ranges[i] != 0) {
+				p.faces.free(ranges[i]);
+			}
+		}
+
+		return false;
+	}
+
+	// The mesh is drawn with another page bound from now on
+	mesh_slot &mesh = m_meshes[idx - 1];
+	if (mesh.page != page) {
+		mesh.page = page;
+		m_dirty = true;
+	}
+
+	for (uint32_t n = 0; n < 6; n++) {
+		set_range(idx, n, ranges[n]);
+
+		if (ranges[n] == 0) {
+			continue;
+		}
+
+		if (p.owners.size() < ranges[n]) {
+			p.owners.resize(ranges[n]);
+		}
+
+		p.owners[ranges[n] - 1] = (idx << 3) | n;
+	}
+
+	return true;
+}
+
+void gl_world_renderer::set_range(uint32_t idx, uint32_t normal,
+				  range_allocator::handle range)
+{
+	mesh_slot &mesh = m_meshes[idx - 1];
+	mesh.ranges[normal] = range;
+
+	if (range == 0) {
+		mesh.offsets[normal] = 0;
+		mesh.capacity[normal] = 0;
+		return;
+	}
+
+	const range_allocator &faces = m_pages[mesh.page]->faces;
+
+	uint32_t scale = mesh.wide ? 1 : 2;
+	mesh.offsets[normal] = faces.get_offset(range) * scale;
+	mesh.capacity[normal] = faces.get_size(range) * scale;
+}
+
+void gl_world_renderer::free_ranges(uint32_t idx)
+{
+	mesh_slot &mesh = m_meshes[idx - 1];
+
+	for (uint32_t n = 0; n < 6; n++) {
+		if (mesh.ranges[n] != 0) {
+			m_pages[mesh.page]->faces.free(mesh.ranges[n]);
+			set_range(idx, n, 0);
+		}
+	}
+}
+
+void gl_world_renderer::add_page()
+{
+	std::unique_ptr<face_page> page = std::make_unique<face_page>();
 
-	for (uint32_t i = 0; i < 6; i++) {
-		cmd.count = faces[i].size() * 6;
-		cmd.instance_count = 1;
-		cmd.first_vertex = fidx * 6;
+	glCreateBuffers(1, &page->buffer);
+	glNamedBufferStorage(page->buffer, m_page_size * sizeof(packed_face),
+			     NULL, GL_DYNAMIC_STORAGE_BIT);
 
-		uniforms.normal = i;
+	page->faces.grow(m_page_size);
+	page->first_draw = 0;
+	page->draws = 0;
 
-		glNamedBufferSubData(m_chunks, fidx * sizeof(packed_face),
-				     faces[i].size() * sizeof(packed_face),
-				     faces[i].data());
+	m_pages.emplace_back(std::move(page));
 
-		glNamedBufferSubData(m_indirect,
-				     idx * sizeof(indirect_draw_command),
-				     sizeof(indirect_draw_command), &cmd);
+	LOG_INFO(Render, "Added a page of chunk faces, {} MiB in all",
+		 m_pages.size() * m_page_size * sizeof(packed_face) >> 20);
+}
+
+void gl_world_renderer::compact()
+{
+	size_t budget = compact_rate.get();
+
+	for (const std::unique_ptr<face_page> &page : m_pages) {
+		while (budget > 0) {
+			range_allocator::handle last = page->faces.get_last();
+			if (last == 0) {
+				break;
+			}
+
+			uint32_t idx = page->owners[last - 1] >> 3;
+			uint32_t normal = page->owners[last - 1] & 7;
+
+			// Still being written by the meshing shader
+			auto pending = [&](const gpu_mesh &m) {
+				return m.mesh == idx;
+			};
+			if (std::any_of(m_gpu_meshes.begin(),
+					m_gpu_meshes.end(), pending)) {
+				break;
+			}
+
+			// Only into the room there is in the page
+			uint32_t units = page->faces.get_size(last);
+			range_allocator::handle range =
+				page->faces.allocate(units);
+			if (range == 0) {
+				break;
+			}
+
+			uint32_t from = page->faces.get_offset(last);
+			uint32_t to = page->faces.get_offset(range);
+			if (to > from) {
+				page->faces.free(range);
+				break;
+			}
+
+			size_t bytes = units * sizeof(packed_face);
+			glCopyNamedBufferSubData(page->buffer, page->buffer,
+						 from * sizeof(packed_face),
+						 to * sizeof(packed_face),
+						 bytes);
+
+			page->owners[range - 1] = page->owners[last - 1];
+			page->faces.free(last);
+
+			set_range(idx, normal, range);
+			update_commands(idx);
+
+			budget -= std::min(budget, bytes);
+		}
+	}
+}
+
+void gl_world_renderer::write_faces(uint32_t idx, uint32_t normal,
+				    const void *faces, uint32_t count)
+{
+	if (count == 0) {
+		return;
+	}
+
+	const mesh_slot &mesh = m_meshes[idx - 1];
+	const size_t stride =
+		mesh.wide ? sizeof(packed_face) : sizeof(uint32_t);
 
-		glNamedBufferSubData(m_uniforms,
-				     idx * sizeof(chunk_uniform_data),
-				     sizeof(chunk_uniform_data), &uniforms);
+	m_staging.write(m_pages[mesh.page]->buffer,
+			mesh.offsets[normal] * stride, count * stride, faces);
+}
+
+void gl_world_renderer::write_info(uint32_t idx,
+				   const world::face_id *textures,
+				   uint32_t count)
+{
+	mesh_info &info = m_meshes[idx - 1].info;
+	info = {};
+	info.wide = count == 0;
+
+	for (uint32_t i = 0; i < count; i++) {
+		info.textures[i / 2] |= static_cast<uint32_t>(textures[i])
+					<< (i % 2 * 16);
+	}
+}
 
-		fidx += faces[i].size();
-		idx++;
+void gl_world_renderer::fill_commands(uint32_t idx,
+				      indirect_draw_command *cmds) const
+{
+	const mesh_slot &mesh = m_meshes[idx - 1];
+
+	// chunk.vert fetches faces by vertex id, four vertices a face
+	for (uint32_t n = 0; n < 6; n++) {
+		int base = static_cast<int>(mesh.offsets[n] * 4);
+		cmds[n] = { .count = mesh.counts[n] * 6,
+			    .instance_count = static_cast<unsigned int>(
+				    mesh.chunks.size()),
+			    .first_index = 0,
+			    .base_vertex = base,
+			    .base_instance = mesh.base_instance };
 	}
 }
 
+void gl_world_renderer::update_commands(uint32_t idx)
+{
+	// Rewritten from scratch before the next draw anyway
+	if (m_dirty) {
+		return;
+	}
+
+	const mesh_slot &mesh = m_meshes[idx - 1];
+
+	indirect_draw_command cmds[6];
+	fill_commands(idx, cmds);
+
+	m_staging.write(m_indirect, mesh.draw * sizeof(cmds), sizeof(cmds),
+			cmds);
+	m_staging.write(m_mesh_info, mesh.draw * sizeof(mesh_info),
+			sizeof(mesh_info), &mesh.info);
+}
+
+void gl_world_renderer::attach_chunk(chunk_handle handle, uint32_t mesh)
+{
+	m_chunk_slots[handle - 1].mesh = mesh;
+	m_meshes[mesh - 1].chunks.push_back(handle);
+}
+
+void gl_world_renderer::detach_chunk(chunk_handle handle)
+{
+	chunk_slot &slot = m_chunk_slots[handle - 1];
+	if (slot.mesh == 0) {
+		return;
+	}
+
+	mesh_slot &mesh = m_meshes[slot.mesh - 1];
+	std::erase(mesh.chunks, handle);
+
+	if (mesh.chunks.empty()) {
+		forget_gpu_mesh(slot.mesh, false);
+		free_ranges(slot.mesh);
+
+		uncache_mesh(slot.mesh);
+		mesh.content.clear();
+		m_free.push(slot.mesh);
+	}
+
+	slot.mesh = 0;
+	m_dirty = true;
+}
+
+void gl_world_renderer::update_instances()
+{
+	mc::world::scratch_scope scratch;
+
+	glm::mat4 *models = scratch.allocate<glm::mat4>(m_chunk_slots.size());
+	uint32_t count = 0;
+
+	// Each page's meshes are drawn in one go, so their commands are
+	// placed together
+	for (const std::unique_ptr<face_page> &page : m_pages) {
+		page->draws = 0;
+	}
+
+	for (const mesh_slot &mesh : m_meshes) {
+		if (!mesh.chunks.empty()) {
+			m_pages[mesh.page]->draws++;
+		}
+	}
+
+	uint32_t draws = 0;
+	for (const std::unique_ptr<face_page> &page : m_pages) {
+		page->first_draw = draws;
+		draws += page->draws;
+		page->draws = 0;
+	}
+
+	indirect_draw_command *cmds =
+		scratch.allocate<indirect_draw_command>(draws * 6);
+	mesh_info *infos = scratch.allocate<mesh_info>(draws);
+
+	for (uint32_t i = 0; i < m_capacity; i++) {
+		mesh_slot &mesh = m_meshes[i];
+		if (mesh.chunks.empty()) {
+			continue;
+		}
+
+		face_page &page = *m_pages[mesh.page];
+		mesh.draw = page.first_draw + page.draws++;
+		mesh.base_instance = count;
+
+		for (chunk_handle handle : mesh.chunks) {
+			models[count++] = m_chunk_slots[handle - 1].model;
+		}
+
+		fill_commands(i + 1, &cmds[mesh.draw * 6]);
+		infos[mesh.draw] = mesh.info;
+	}
+
+	if (count > m_instance_capacity) {
+		// The writes to the old buffer were flushed by the last update
+		m_instance_capacity = count * 1.5;
+		m_instances =
+			gl_grow_buffer(m_instances, 0,
+				       m_instance_capacity * sizeof(glm::mat4));
+	}
+
+	m_staging.write(m_instances, 0, count * sizeof(glm::mat4), models);
+	m_staging.write(m_indirect, 0,
+			draws * 6 * sizeof(indirect_draw_command), cmds);
+	m_staging.write(m_mesh_info, 0, draws * sizeof(mesh_info), infos);
+
+	// Meshes still being counted on the GPU take their counts from there,
+	// over the commands just staged
+	m_staging.flush();
+
+	for (const gpu_mesh &m : m_gpu_meshes) {
+		uint32_t draw = m_meshes[m.mesh - 1].draw;
+
+		for (uint32_t n = 0; n < 6; n++) {
+			uint32_t src = (m.mesh - 1) * 6 + n;
+			uint32_t dst = draw * 6 + n;
+			glCopyNamedBufferSubData(
+				m_counts, m_indirect, src * sizeof(GLuint),
+				dst * sizeof(indirect_draw_command),
+				sizeof(GLuint));
+		}
+	}
+
+	m_dirty = false;
+}
+
 void gl_world_renderer::render(const glm::mat4 &view,
 			       const glm::mat4 &projection)
 {
+	// The faces uploaded since the last frame land before they are moved
+	m_staging.flush();
+
+	std::erase_if(m_gpu_meshes,
+		      [&](const gpu_mesh &m) { return read_gpu_counts(m, 0); });
+
+	compact();
+
+	if (m_dirty) {
+		update_instances();
+	}
+
+	m_staging.flush();
+
+	glBindVertexArray(m_vao);
 	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirect);
 
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_chunks);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_uniforms);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_instances);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_mesh_info);
 
 	glBindTextureUnit(1, m_texarray);
 
@@ -256,26 +1116,42 @@ void gl_world_renderer::render(const glm::mat4 &view,
 			   glm::value_ptr(projection));
 	glUniform1i(m_texture, 1);
 
-	glMultiDrawArraysIndirect(GL_TRIANGLES, NULL, m_capacity * 6, 0);
+	for (const std::unique_ptr<face_page> &page : m_pages) {
+		if (page->draws == 0) {
+			continue;
+		}
+
+		size_t offset =
+			page->first_draw * 6 * sizeof(indirect_draw_command);
+		const void *first = reinterpret_cast<const void *>(offset);
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, page->buffer);
+		glUniform1ui(m_first_mesh, page->first_draw);
+
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+					    first, page->draws * 6, 0);
+	}
 }
 
 void gl_world_renderer::grow(uint32_t capacity)
 {
-	m_chunks = gl_grow_buffer(
-		m_chunks, m_capacity * CHUNK_MESH_SIZE * sizeof(packed_face),
-		capacity * CHUNK_MESH_SIZE * sizeof(packed_face));
-
-	m_uniforms = gl_grow_buffer(m_uniforms,
-				    m_capacity * 6 * sizeof(chunk_uniform_data),
-				    capacity * 6 * sizeof(chunk_uniform_data));
+	// Draw commands and mesh infos are rewritten from m_meshes before the
+	// next draw. Only the counts of meshes in flight on the GPU are kept,
+	// a few bytes a slot, while faces stay in their pages. Staged writes
+	// to the old buffers land before they are deleted.
+	m_staging.flush();
 
 	m_indirect = gl_grow_buffer(
-		m_indirect, m_capacity * 6 * sizeof(indirect_draw_command),
-		capacity * 6 * sizeof(indirect_draw_command));
+		m_indirect, 0, capacity * 6 * sizeof(indirect_draw_command));
+
+	m_counts = gl_grow_buffer(m_counts, m_capacity * 6 * sizeof(GLuint),
+				  capacity * 6 * sizeof(GLuint));
+
+	m_mesh_info =
+		gl_grow_buffer(m_mesh_info, 0, capacity * sizeof(mesh_info));
 
-	gl_write_zeros(
-		m_indirect, m_capacity * 6 * sizeof(indirect_draw_command),
-		(capacity - m_capacity) * 6 * sizeof(indirect_draw_command));
+	m_meshes.resize(capacity);
+	m_dirty = true;
 
 	for (uint32_t i = capacity; i != m_capacity; i--) {
 		m_free.emplace(i);
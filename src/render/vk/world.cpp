@@ -24,12 +24,29 @@ void vk_world_renderer::free_chunk(chunk_handle handle)
 {
 }
 
-void vk_world_renderer::upload_chunk(chunk_handle handle,
-				     mc::world::chunk_draw_data *draw_data,
+void vk_world_renderer::upload_chunk(chunk_handle handle, uint64_t hash,
+				     const mc::world::chunk_mesh *mesh,
 				     const glm::mat4 &model)
 {
 }
 
+void vk_world_renderer::patch_chunk(chunk_handle handle, uint64_t hash,
+				    const mc::world::chunk_mesh *mesh,
+				    uint8_t normals)
+{
+}
+
+bool vk_world_renderer::meshes_voxels() const
+{
+	return false;
+}
+
+void vk_world_renderer::upload_voxels(chunk_handle handle, uint64_t hash,
+				      const mc::world::chunk *ch,
+				      const glm::mat4 &model)
+{
+}
+
 void vk_world_renderer::render(const glm::mat4 &view,
 			       const glm::mat4 &projection)
 {
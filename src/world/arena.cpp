@@ -0,0 +1,166 @@
+#include "mineclonelib/world/arena.h"
+#include "mineclonelib/log.h"
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace mc
+{
+namespace world
+{
+void *map_slab(size_t size, bool huge_pages)
+{
+#ifdef __linux__
+	void *slab = MAP_FAILED;
+
+	// Explicit huge pages only succeed if the system reserved some, so fall
+	// back to transparent huge pages over an over-aligned mapping
+	if (huge_pages) {
+		slab = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	}
+
+	if (slab != MAP_FAILED) {
+		return slab;
+	}
+
+	size_t mapped = size + SLAB_SIZE;
+	uint8_t *base = static_cast<uint8_t *>(
+		mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+
+	if (base == MAP_FAILED) {
+		LOG_CRITICAL(Default, "Failed to map a {} byte chunk slab",
+			     size);
+		throw std::bad_alloc();
+	}
+
+	uintptr_t addr = reinterpret_cast<uintptr_t>(base);
+	uintptr_t aligned = (addr + SLAB_SIZE - 1) & ~uintptr_t(SLAB_SIZE - 1);
+
+	size_t head = aligned - addr;
+	size_t tail = mapped - head - size;
+
+	if (head != 0) {
+		munmap(base, head);
+	}
+
+	if (tail != 0) {
+		munmap(reinterpret_cast<uint8_t *>(aligned) + size, tail);
+	}
+
+	if (huge_pages) {
+		madvise(reinterpret_cast<void *>(aligned), size,
+			MADV_HUGEPAGE);
+	}
+
+	return reinterpret_cast<void *>(aligned);
+#else
+	return ::operator new(size, std::align_val_t(SLAB_SIZE));
+#endif
+}
+
+void unmap_slab(void *slab, size_t size)
+{
+#ifdef __linux__
+	munmap(slab, size);
+#else
+	::operator delete(slab, std::align_val_t(SLAB_SIZE));
+#endif
+}
+
+scratch_arena::scratch_arena()
+	: m_block(0)
+	, m_offset(0)
+	, m_depth(0)
+	, m_heap_allocations(0)
+{
+}
+
+scratch_arena &scratch_arena::get()
+{
+	thread_local scratch_arena arena;
+	return arena;
+}
+
+void *scratch_arena::allocate(size_t size, size_t align)
+{
+	for (; m_block < m_blocks.size(); m_block++, m_offset = 0) {
+		block &b = m_blocks[m_block];
+
+		uintptr_t base = reinterpret_cast<uintptr_t>(b.data.get());
+		uintptr_t start = (base + m_offset + align - 1) & ~(align - 1);
+
+		size_t offset = start - base;
+		if (offset + size <= b.size) {
+			m_offset = offset + size;
+			return b.data.get() + offset;
+		}
+	}
+
+	// Doubles the capacity, so a job needs few blocks before the next reset
+	// merges them
+	size_t block_size = std::max<size_t>(
+		{ size + align, capacity(), SCRATCH_BLOCK_SIZE });
+
+	m_blocks.push_back(
+		{ std::make_unique_for_overwrite<std::byte[]>(block_size),
+		  block_size });
+	m_heap_allocations++;
+
+	m_block = m_blocks.size() - 1;
+	m_offset = 0;
+
+	return allocate(size, align);
+}
+
+size_t scratch_arena::capacity() const noexcept
+{
+	size_t total = 0;
+	for (const block &b : m_blocks) {
+		total += b.size;
+	}
+
+	return total;
+}
+
+void scratch_arena::reset()
+{
+	m_block = 0;
+	m_offset = 0;
+
+	if (m_blocks.size() <= 1) {
+		return;
+	}
+
+	size_t total = capacity();
+
+	m_blocks.clear();
+	m_blocks.push_back(
+		{ std::make_unique_for_overwrite<std::byte[]>(total), total });
+	m_heap_allocations++;
+}
+
+scratch_scope::scratch_scope()
+	: m_arena(scratch_arena::get())
+	, m_block(m_arena.m_block)
+	, m_offset(m_arena.m_offset)
+{
+	m_arena.m_depth++;
+}
+
+scratch_scope::~scratch_scope()
+{
+	if (--m_arena.m_depth == 0) {
+		m_arena.reset();
+		return;
+	}
+
+	m_arena.m_block = m_block;
+	m_arena.m_offset = m_offset;
+}
+}
+}
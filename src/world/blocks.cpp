@@ -1,5 +1,6 @@
 #include "mineclonelib/world/blocks.h"
 #include "mineclonelib/io/assets.h"
+#include "mineclonelib/log.h"
 
 #include <memory>
 
@@ -10,6 +11,10 @@ namespace world
 face_id face_registry::register_face(std::unique_ptr<face> &&face)
 {
 	face_id id = m_faces.size();
+	LOG_ASSERT(Default, !m_frozen,
+		   "Face {} registered after the block properties were built",
+		   id);
+
 	m_faces.emplace_back(std::move(face));
 	return id;
 }
@@ -17,6 +22,10 @@ face_id face_registry::register_face(std::unique_ptr<face> &&face)
 block_id block_registry::register_block(std::unique_ptr<block> &&block)
 {
 	block_id id = m_blocks.size();
+	LOG_ASSERT(Default, !m_frozen,
+		   "Block {} registered after the block properties were built",
+		   id);
+
 	m_blocks.emplace_back(std::move(block));
 	return id;
 }
@@ -64,6 +73,36 @@ class simple_block : public block {
 	}
 };
 
+block_properties::block_properties(const block_registry *breg,
+				   const face_registry *freg)
+	: m_opaque((breg->size() + 63) / 64, 0)
+	, m_faces(breg->size() * 6, 0)
+	, m_renderable((freg->size() + 63) / 64, 0)
+	, m_renderable_faces(breg->size(), 0)
+{
+	for (uint32_t f = 0; f < freg->size(); f++) {
+		if (freg->get(f)->get_texture() != nullptr) {
+			m_renderable[f >> 6] |= 1ull << (f & 63);
+		}
+	}
+
+	for (uint32_t b = 0; b < breg->size(); b++) {
+		block *blk = breg->get(b);
+		if (blk->is_opaque()) {
+			m_opaque[b >> 6] |= 1ull << (b & 63);
+		}
+
+		for (int k = 0; k < 6; k++) {
+			face_id f = blk->get_face(static_cast<block_face>(k));
+			m_faces[b * 6 + k] = f;
+
+			if (is_renderable(f)) {
+				m_renderable_faces[b] |= 1 << k;
+			}
+		}
+	}
+}
+
 namespace faces
 {
 face_registry *get_registry()
@@ -86,6 +125,17 @@ block_registry *get_registry()
 	return &reg;
 }
 
+const block_properties *get_properties()
+{
+	// Later registrations would be missing from the table
+	static const block_properties props = [] {
+		get_registry()->freeze();
+		faces::get_registry()->freeze();
+		return block_properties(get_registry(), faces::get_registry());
+	}();
+	return &props;
+}
+
 block_id air = get_registry()->register_block(
 	std::make_unique<simple_block>(faces::air, false));
 block_id dirt = get_registry()->register_block(
@@ -1,5 +1,19 @@
 #include "mineclonelib/world/chunk.h"
+#include "mineclonelib/world/ao.h"
+#include "mineclonelib/world/arena.h"
 #include "mineclonelib/world/blocks.h"
+#include "mineclonelib/world/compression.h"
+#include "mineclonelib/log.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <type_traits>
+#include <vector>
 
 namespace mc
 {
@@ -52,83 +66,1198 @@ static const uint8_t c_ao[] = {
 	95,  159, 255, 255, 111, 175, 255, 255
 };
 
-chunk_draw_data simple_chunk_draw_data_generator::generate(chunk *ch) const
+// Offset to the neighbour in front of a face, and the axes around it that
+// ambient occlusion samples, by block_face
+static constexpr int c_dx[] = { 1, -1, 0, 0, 0, 0 };
+static constexpr int c_dy[] = { 0, 0, 1, -1, 0, 0 };
+static constexpr int c_dz[] = { 0, 0, 0, 0, 1, -1 };
+
+static constexpr int c_dleftx[] = { 0, 0, 0, -1, -1, 0 };
+static constexpr int c_dlefty[] = { -1, 0, 0, 0, 0, -1 };
+static constexpr int c_dleftz[] = { 0, -1, -1, 0, 0, 0 };
+
+static constexpr int c_dtopx[] = { 0, 0, 1, 0, 0, 1 };
+static constexpr int c_dtopy[] = { 0, 1, 0, 0, 1, 0 };
+static constexpr int c_dtopz[] = { 1, 0, 0, 1, 0, 0 };
+
+// Axes a merged quad grows along, by block_face. They match dleft and dtop
+// in the chunk shader, which are unrelated to the sampling axes above.
+static constexpr int c_quad_left[] = { 2, 1, 0, 2, 1, 0 };
+static constexpr int c_quad_top[] = { 1, 2, 2, 0, 0, 1 };
+
+template <uint32_t size_log>
+static bool is_interior_uniform(const block_id *dense)
+{
+	using dims = chunk_dims<size_log>;
+	using chunk = basic_chunk<size_log>;
+
+	block_id first =
+		dense[chunk::index(dims::begin, dims::begin, dims::begin)];
+	for (int x = dims::begin; x < dims::end; x++) {
+		for (int y = dims::begin; y < dims::end; y++) {
+			const block_id *row =
+				dense + chunk::index(x, y, dims::begin);
+			for (int z = 0; z < dims::size; z++) {
+				if (row[z] != first) {
+					return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+static bool has_visible_faces(block_id id)
+{
+	return blocks::get_properties()->get_renderable_faces(id) != 0;
+}
+
+uint8_t get_face_ao(uint32_t samples) noexcept
+{
+	return c_ao[samples & 511];
+}
+
+// Ambient occlusion of face k of a block, given the block n in front of it
+// and opaque(x, y, z) telling whether a block is opaque
+template <typename fn>
+static uint8_t face_ao(fn &&opaque, int k, int nx, int ny, int nz)
+{
+	uint16_t mask = 0;
+	int bit = 1;
+	for (int di = -1; di <= 1; di++) {
+		for (int dj = -1; dj <= 1; dj++) {
+			int x = nx + c_dleftx[k] * di + c_dtopx[k] * dj;
+			int y = ny + c_dlefty[k] * di + c_dtopy[k] * dj;
+			int z = nz + c_dleftz[k] * di + c_dtopz[k] * dj;
+
+			if (opaque(x, y, z)) {
+				mask |= bit;
+			}
+
+			bit <<= 1;
+		}
+	}
+
+	return c_ao[mask];
+}
+
+// A block_face as constants, so that each direction's loops get their
+// neighbour and AO sample offsets folded in
+template <uint32_t size_log, int k> struct face_dir {
+	using dims = chunk_dims<size_log>;
+
+	static constexpr block_face face = static_cast<block_face>(k);
+
+	static constexpr int axis = k >> 1;
+	static constexpr int left = c_quad_left[k];
+	static constexpr int top = c_quad_top[k];
+
+	static constexpr int offset(int x, int y, int z)
+	{
+		return (x * dims::total + y) * dims::total + z;
+	}
+
+	// Offset in a dense array to the block in front of the face
+	static constexpr int front = offset(c_dx[k], c_dy[k], c_dz[k]);
+
+	// Offset along axis a of each AO sample from the block in front, in
+	// c_ao bit order
+	static constexpr std::array<int, 9> samples_along(int a)
+	{
+		const int l[3] = { c_dleftx[k], c_dlefty[k], c_dleftz[k] };
+		const int t[3] = { c_dtopx[k], c_dtopy[k], c_dtopz[k] };
+
+		std::array<int, 9> d{};
+		for (int b = 0; b < 9; b++) {
+			d[b] = l[a] * (b / 3 - 1) + t[a] * (b % 3 - 1);
+		}
+
+		return d;
+	}
+
+	// Offset in a dense array of each AO sample from the face's block
+	static constexpr std::array<int, 9> samples = [] {
+		const std::array<int, 9> x = samples_along(0);
+		const std::array<int, 9> y = samples_along(1);
+		const std::array<int, 9> z = samples_along(2);
+
+		std::array<int, 9> d{};
+		for (int b = 0; b < 9; b++) {
+			d[b] = front + offset(x[b], y[b], z[b]);
+		}
+
+		return d;
+	}();
+};
+
+// Calls f(dir) once per block_face, in order, with dir an
+// std::integral_constant holding the face
+template <typename fn> static inline void for_each_face(fn &&f)
+{
+	f(std::integral_constant<int, 0>());
+	f(std::integral_constant<int, 1>());
+	f(std::integral_constant<int, 2>());
+	f(std::integral_constant<int, 3>());
+	f(std::integral_constant<int, 4>());
+	f(std::integral_constant<int, 5>());
+}
+
+// Renderable faces of a block by bit, as in get_renderable_faces(), with
+// its opacity in FLAG_OPAQUE
+#define FLAG_OPAQUE (1u << 6)
+
+static void load_flags(const block_id *dense, size_t count, uint8_t *flags)
+{
+	const block_properties *props = blocks::get_properties();
+	for (size_t i = 0; i < count; i++) {
+		flags[i] = props->get_renderable_faces(dense[i]) |
+			   (props->is_opaque(dense[i]) ? FLAG_OPAQUE : 0);
+	}
+}
+
+template <uint32_t size_log> static inline bool is_interior(int c)
+{
+	using dims = chunk_dims<size_log>;
+
+	return c >= dims::begin && c < dims::end;
+}
+
+template <uint32_t size_log>
+basic_occupancy<size_log>::basic_occupancy(bool opaque)
+{
+	uint64_t column = opaque ? dims::column_mask : 0;
+	for (int a = 0; a < dims::total; a++) {
+		for (int b = 0; b < dims::total; b++) {
+			m_x[a][b] = column;
+			m_y[a][b] = column;
+			m_z[a][b] = column;
+		}
+	}
+
+	m_corners = opaque ? 0xff : 0;
+}
+
+template <uint32_t size_log>
+bool basic_occupancy<size_log>::get(int x, int y, int z) const noexcept
+{
+	if (is_interior<size_log>(z)) {
+		return (m_z[x][y] >> (z - dims::begin)) & 1;
+	}
+
+	if (is_interior<size_log>(y)) {
+		return (m_y[x][z] >> (y - dims::begin)) & 1;
+	}
+
+	if (is_interior<size_log>(x)) {
+		return (m_x[y][z] >> (x - dims::begin)) & 1;
+	}
+
+	int corner = (x != 0) << 2 | (y != 0) << 1 | (z != 0);
+	return (m_corners >> corner) & 1;
+}
+
+template <uint32_t size_log>
+void basic_occupancy<size_log>::set(int x, int y, int z, bool opaque) noexcept
+{
+	bool interior = false;
+
+	if (is_interior<size_log>(x)) {
+		uint64_t bit = 1ull << (x - dims::begin);
+		m_x[y][z] = opaque ? m_x[y][z] | bit : m_x[y][z] & ~bit;
+		interior = true;
+	}
+
+	if (is_interior<size_log>(y)) {
+		uint64_t bit = 1ull << (y - dims::begin);
+		m_y[x][z] = opaque ? m_y[x][z] | bit : m_y[x][z] & ~bit;
+		interior = true;
+	}
+
+	if (is_interior<size_log>(z)) {
+		uint64_t bit = 1ull << (z - dims::begin);
+		m_z[x][y] = opaque ? m_z[x][y] | bit : m_z[x][y] & ~bit;
+		interior = true;
+	}
+
+	if (!interior) {
+		uint8_t bit = 1 << ((x != 0) << 2 | (y != 0) << 1 | (z != 0));
+		m_corners = opaque ? m_corners | bit : m_corners & ~bit;
+	}
+}
+
+template <uint32_t size_log>
+basic_chunk<size_log>::basic_chunk(block_id fill)
+	: m_storage(dims::total * dims::total * dims::total, fill)
+	, m_is_cold(false)
+	, m_last_access(access_clock.load(std::memory_order_relaxed))
+	, m_opaque(blocks::get_properties()->is_opaque(fill))
+	, m_epoch(0)
+	, m_generation(1)
+	, m_clean_generation(0)
+	, m_neighbours{}
+{
+	std::fill(m_sections, m_sections + dims::sections, m_generation);
+}
+
+template <uint32_t size_log>
+basic_chunk<size_log>::basic_chunk(const basic_chunk &other)
+	: m_storage(other.get_storage())
+	, m_is_cold(false)
+	, m_last_access(other.get_last_access())
+	, m_opaque(other.m_opaque)
+	, m_epoch(other.m_epoch)
+	, m_generation(other.m_generation)
+	, m_clean_generation(other.m_clean_generation)
+{
+	if (other.m_occupancy != nullptr) {
+		m_occupancy = std::make_unique<occupancy_type>(
+			*other.m_occupancy);
+	}
+
+	std::copy(other.m_sections, other.m_sections + dims::sections,
+		  m_sections);
+	std::copy(other.m_neighbours, other.m_neighbours + 27, m_neighbours);
+}
+
+template <uint32_t size_log>
+void basic_chunk<size_log>::fill(block_id block)
+{
+	m_cold = std::vector<uint8_t>();
+	m_is_cold.store(false, std::memory_order_relaxed);
+	m_storage.fill(block);
+	m_occupancy.reset();
+	m_opaque = blocks::get_properties()->is_opaque(block);
+
+	m_generation++;
+	std::fill(m_sections, m_sections + dims::sections, m_generation);
+}
+
+template <uint32_t size_log>
+void basic_chunk<size_log>::freeze(std::vector<uint8_t> &&compressed)
+{
+	cold_tier_counters &counters = get_cold_tier_counters();
+	counters.compressed++;
+	counters.raw_bytes += memory_usage();
+	counters.compressed_bytes += compressed.capacity();
+
+	m_cold = std::move(compressed);
+	m_storage.release();
+	m_occupancy.reset();
+	m_is_cold.store(true, std::memory_order_release);
+}
+
+template <uint32_t size_log> void basic_chunk<size_log>::thaw()
 {
-	static const int dx[] = { 1, -1, 0, 0, 0, 0 };
-	static const int dy[] = { 0, 0, 1, -1, 0, 0 };
-	static const int dz[] = { 0, 0, 0, 0, 1, -1 };
+	// Readers of a world snapshot may race to decompress the same chunk
+	static std::mutex mutex;
+	std::lock_guard lock(mutex);
+
+	if (!m_is_cold.load(std::memory_order_relaxed)) {
+		return;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+
+	// The blob was encoded in this process, so failing to decode it means
+	// memory corruption. Carrying on would hand out a chunk with no
+	// storage, so give up while the blob is still around to inspect.
+	if (!m_storage.decode(m_cold.data(), m_cold.size())) {
+		LOG_CRITICAL(Default,
+			     "Failed to decompress a {} byte cold chunk",
+			     m_cold.size());
+		std::abort();
+	}
 
-	static const int dleftx[] = { 0, 0, 0, -1, -1, 0 };
-	static const int dlefty[] = { -1, 0, 0, 0, 0, -1 };
-	static const int dleftz[] = { 0, -1, -1, 0, 0, 0 };
+	m_cold = std::vector<uint8_t>();
+	rebuild_occupancy();
+	m_is_cold.store(false, std::memory_order_release);
 
-	static const int dtopx[] = { 0, 0, 1, 0, 0, 1 };
-	static const int dtopy[] = { 0, 1, 0, 0, 1, 0 };
-	static const int dtopz[] = { 1, 0, 0, 1, 0, 0 };
+	auto end = std::chrono::steady_clock::now();
+
+	record_decompression(
+		std::chrono::duration_cast<std::chrono::nanoseconds>(end -
+								     start)
+			.count());
+}
+
+template <uint32_t size_log> void basic_chunk<size_log>::rebuild_occupancy()
+{
+	const block_properties *props = blocks::get_properties();
+	const std::vector<block_id> &palette = m_storage.palette();
+
+	size_t opaque_count = 0;
+	for (block_id block : palette) {
+		opaque_count += props->is_opaque(block);
+	}
+
+	m_occupancy.reset();
+	m_opaque = opaque_count != 0;
+
+	if (opaque_count == 0 || opaque_count == palette.size()) {
+		return;
+	}
+
+	std::vector<block_id> dense(dims::total * dims::total * dims::total);
+	m_storage.unpack(dense.data());
+
+	m_occupancy = std::make_unique<occupancy_type>(false);
+
+	for (int x = 0; x < dims::total; x++) {
+		for (int y = 0; y < dims::total; y++) {
+			for (int z = 0; z < dims::total; z++) {
+				if (props->is_opaque(dense[index(x, y, z)])) {
+					m_occupancy->set(x, y, z, true);
+				}
+			}
+		}
+	}
+}
+
+static inline uint64_t mix64(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+template <uint32_t size_log>
+uint64_t basic_chunk<size_log>::content_hash() const
+{
+	if (is_uniform()) {
+		return mix64(get(0, 0, 0) + 1);
+	}
+
+	scratch_scope scratch;
+
+	// Padded so the blocks can be read 64 bits at a time
+	const uint32_t count = dims::total * dims::total * dims::total;
+	const uint32_t padded = (count + 3) & ~3u;
+	block_id *dense = scratch.allocate<block_id>(padded);
+	std::fill(dense + count, dense + padded, 0);
+	unpack(dense);
+
+	uint64_t h = count;
+	for (uint32_t i = 0; i < padded; i += 4) {
+		uint64_t word;
+		std::memcpy(&word, &dense[i], sizeof(word));
+
+		h = std::rotl(h ^ (word * 0x9e3779b97f4a7c15ull), 29) *
+		    0xbf58476d1ce4e5b9ull;
+	}
+
+	return mix64(h);
+}
+
+template <uint32_t size_log>
+void basic_chunk<size_log>::encode_content(std::vector<uint8_t> &out) const
+{
+	const uint32_t count = dims::total * dims::total * dims::total;
+
+	// Runs of block ids rather than of palette indices, which depend on
+	// the order blocks were first set in. Reused, so hashing and checking
+	// a chunk whose mesh is cached allocates nothing once warm.
+	thread_local std::vector<uint8_t> runs;
+	runs.clear();
+
+	if (is_uniform()) {
+		write_varint(runs, get(0, 0, 0));
+		write_varint(runs, count);
+	} else {
+		scratch_scope scratch;
+		block_id *dense = scratch.allocate<block_id>(count);
+		unpack(dense);
+
+		uint32_t idx = 0;
+		while (idx < count) {
+			uint32_t run = 1;
+			while (idx + run < count &&
+			       dense[idx + run] == dense[idx]) {
+				run++;
+			}
+
+			write_varint(runs, dense[idx]);
+			write_varint(runs, run);
+			idx += run;
+		}
+	}
+
+	write_varint(out, runs.size());
+	lz_compress(runs.data(), runs.size(), out);
+}
+
+template <uint32_t size_log>
+typename basic_chunk<size_log>::section_mask
+basic_chunk<size_log>::changed_since(uint32_t generation) const noexcept
+{
+	section_mask mask;
+	for (int i = 0; i < dims::sections; i++) {
+		if (m_sections[i] > generation) {
+			mask.set(i);
+		}
+	}
+
+	return mask;
+}
+
+template <uint32_t size_log>
+typename basic_chunk<size_log>::section_mask
+basic_chunk<size_log>::dilate(const section_mask &mask) noexcept
+{
+	const int n = dims::sections_per_axis;
+
+	section_mask result = mask;
+	for (int i = 0; i < dims::sections; i++) {
+		if (!mask.test(i)) {
+			continue;
+		}
+
+		int x = i / (n * n), y = (i / n) % n, z = i % n;
+		for (int sx = std::max(x - 1, 0); sx <= std::min(x + 1, n - 1);
+		     sx++) {
+			for (int sy = std::max(y - 1, 0);
+			     sy <= std::min(y + 1, n - 1); sy++) {
+				for (int sz = std::max(z - 1, 0);
+				     sz <= std::min(z + 1, n - 1); sz++) {
+					result.set((sx * n + sy) * n + sz);
+				}
+			}
+		}
+	}
+
+	return result;
+}
+
+// Halo coordinates along one axis that face the neighbour at offset d
+template <uint32_t size_log>
+static void halo_range(int d, int &begin, int &end)
+{
+	using dims = chunk_dims<size_log>;
+
+	if (d < 0) {
+		begin = 0;
+		end = dims::begin;
+	} else if (d > 0) {
+		begin = dims::end;
+		end = dims::total;
+	} else {
+		begin = dims::begin;
+		end = dims::end;
+	}
+}
+
+template <uint32_t size_log>
+void basic_chunk<size_log>::pull_halo(int dx, int dy, int dz)
+{
+	basic_chunk *n = get_neighbour(dx, dy, dz);
+	if (n == nullptr) {
+		return;
+	}
+
+	int bx, ex, by, ey, bz, ez;
+	halo_range<size_log>(dx, bx, ex);
+	halo_range<size_log>(dy, by, ey);
+	halo_range<size_log>(dz, bz, ez);
+
+	int ox = -dx * dims::size, oy = -dy * dims::size,
+	    oz = -dz * dims::size;
+
+	for (int x = bx; x < ex; x++) {
+		for (int y = by; y < ey; y++) {
+			for (int z = bz; z < ez; z++) {
+				store(x, y, z, n->get(x + ox, y + oy, z + oz));
+			}
+		}
+	}
+}
+
+template <uint32_t size_log>
+void basic_chunk<size_log>::update_occupancy(int x, int y, int z,
+					     block_id block)
+{
+	bool opaque = blocks::get_properties()->is_opaque(block);
+
+	if (m_occupancy == nullptr) {
+		if (opaque == m_opaque) {
+			return;
+		}
+
+		m_occupancy = std::make_unique<occupancy_type>(m_opaque);
+	}
+
+	m_occupancy->set(x, y, z, opaque);
+}
+
+template <uint32_t size_log>
+void basic_chunk<size_log>::propagate(int x, int y, int z, block_id block)
+{
+	// Writes into the halo itself are not forwarded
+	if (!is_interior<size_log>(x) || !is_interior<size_log>(y) ||
+	    !is_interior<size_log>(z)) {
+		return;
+	}
+
+	int lo[3], hi[3];
+	const int c[3] = { x, y, z };
+	for (int a = 0; a < 3; a++) {
+		lo[a] = (c[a] == dims::begin ? -1 : 0);
+		hi[a] = (c[a] == dims::end - 1 ? 1 : 0);
+	}
+
+	for (int dx = lo[0]; dx <= hi[0]; dx++) {
+		for (int dy = lo[1]; dy <= hi[1]; dy++) {
+			for (int dz = lo[2]; dz <= hi[2]; dz++) {
+				basic_chunk *n = get_neighbour(dx, dy, dz);
+				if (n == nullptr) {
+					continue;
+				}
+
+				n->store(x - dx * dims::size,
+					 y - dy * dims::size,
+					 z - dz * dims::size, block);
+			}
+		}
+	}
+}
+
+// Calls emit(face) for every visible face of direction k. Rows are walked
+// along z, which is contiguous in the dense array.
+template <uint32_t size_log, int k, typename fn>
+static void simple_direction(const block_id *dense, const uint8_t *flags,
+			     bool boundary_only, fn &&emit)
+{
+	using dims = chunk_dims<size_log>;
+	using chunk = basic_chunk<size_log>;
+	using dir = face_dir<size_log, k>;
+
+	const block_properties *props = blocks::get_properties();
+
+	int begin[3] = { dims::begin, dims::begin, dims::begin };
+	int end[3] = { dims::end, dims::end, dims::end };
+	if (boundary_only) {
+		constexpr int d[3] = { c_dx[k], c_dy[k], c_dz[k] };
+		for (int a = 0; a < 3; a++) {
+			if (d[a] > 0) {
+				begin[a] = dims::end - 1;
+			} else if (d[a] < 0) {
+				end[a] = dims::begin + 1;
+			}
+		}
+	}
+
+	for (int x = begin[0]; x < end[0]; x++) {
+		for (int y = begin[1]; y < end[1]; y++) {
+			const uint32_t row = chunk::index(x, y, 0);
+
+			for (int z = begin[2]; z < end[2]; z++) {
+				const uint32_t idx = row + z;
+
+				uint8_t covered = flags[idx + dir::front];
+				if (((flags[idx] & ~covered) >> k & 1) == 0) {
+					continue;
+				}
+
+				uint16_t mask = 0;
+				for (int b = 0; b < 9; b++) {
+					uint8_t sample =
+						flags[idx + dir::samples[b]];
+					mask |= ((sample & FLAG_OPAQUE) != 0)
+						<< b;
+				}
+
+				face_id faceid =
+					props->get_face(dense[idx], dir::face);
+
+				emit(face_draw_data(faceid, dir::face,
+						    c_ao[mask], x, y, z));
+			}
+		}
+	}
+}
+
+// Calls emit(face) for every visible face, one normal after the other
+template <uint32_t size_log, typename fn>
+static void simple_faces(const basic_chunk<size_log> *ch, fn &&emit)
+{
+	using dims = chunk_dims<size_log>;
+	using chunk = basic_chunk<size_log>;
+
+	// Every face of a uniform chunk has the same block on both sides
+	if (ch->is_uniform()) {
+		return;
+	}
+
+	const size_t count = dims::total * dims::total * dims::total;
+
+	scratch_scope scratch;
+
+	block_id *dense = scratch.allocate<block_id>(count);
+	ch->unpack(dense);
+
+	// With a uniform interior, only faces on the chunk boundary can be
+	// visible, and then only if the interior block has any faces at all
+	bool boundary_only = is_interior_uniform<size_log>(dense);
+	if (boundary_only &&
+	    !has_visible_faces(dense[chunk::index(dims::begin, dims::begin,
+						   dims::begin)])) {
+		return;
+	}
+
+	uint8_t *flags = scratch.allocate<uint8_t>(count);
+	load_flags(dense, count, flags);
+
+	for_each_face([&](auto k) {
+		simple_direction<size_log, decltype(k)::value>(
+			dense, flags, boundary_only, emit);
+	});
+}
+
+template <uint32_t size_log>
+chunk_draw_data basic_simple_chunk_draw_data_generator<size_log>::generate(
+	const basic_chunk<size_log> *ch) const
+{
+	scratch_scope scratch;
+
+	// Staged so the result is allocated once, at its final size
+	face_draw_data *faces = scratch.allocate<face_draw_data>(
+		chunk_dims<size_log>::max_faces);
+	size_t count = 0;
+
+	simple_faces<size_log>(
+		ch, [&](const face_draw_data &face) { faces[count++] = face; });
 
 	chunk_draw_data data;
+	data.faces.assign(faces, faces + count);
+	return data;
+}
+
+template <uint32_t size_log>
+void basic_simple_chunk_draw_data_generator<size_log>::generate(
+	const basic_chunk<size_log> *ch, basic_face_sink<size_log> &sink) const
+{
+	simple_faces<size_log>(
+		ch, [&](const face_draw_data &face) { sink.push(face); });
+}
+
+// Opacity of a row of blocks along a quad's left axis: bit i is interior
+// block i, lo and hi are the halo blocks before and after the row
+struct opacity_row {
+	uint64_t bits;
+	uint64_t lo, hi;
+};
+
+// The row shifted so bit i holds the block at i + shift
+template <uint32_t size_log>
+static inline uint64_t shift_row(const opacity_row &row, int shift)
+{
+	using dims = chunk_dims<size_log>;
+
+	if (shift > 0) {
+		return (row.bits >> 1) | (row.hi << (dims::size - 1));
+	} else if (shift < 0) {
+		return ((row.bits << 1) | row.lo) & dims::column_mask;
+	}
+
+	return row.bits;
+}
+
+// Indices of c_ao for a row of faces, with the kernel the build selects
+static inline void gather_ao_indices(const uint64_t *words, uint8_t *lo,
+				     uint8_t *hi)
+{
+#if defined(MINECLONE_SIMD_AVX2)
+	gather_ao_indices_avx2(words, lo, hi);
+#elif defined(MINECLONE_SIMD_SSE4)
+	gather_ao_indices_sse4(words, lo, hi);
+#else
+	gather_ao_indices_scalar(words, lo, hi);
+#endif
+}
+
+// Loads the opacity of every row along top of the layer at layer along axis
+template <uint32_t size_log>
+static void load_layer(const basic_occupancy<size_log> *occupancy,
+		       bool opaque, int axis, int left, int top, int layer,
+		       opacity_row *rows)
+{
+	using dims = chunk_dims<size_log>;
+
+	for (int t = 0; t < dims::total; t++) {
+		if (occupancy == nullptr) {
+			rows[t] = { opaque ? dims::column_mask : 0, opaque,
+				    opaque };
+			continue;
+		}
+
+		int pos[3];
+		pos[axis] = layer;
+		pos[top] = t;
+
+		pos[left] = 0;
+		uint64_t lo = occupancy->get(pos[0], pos[1], pos[2]);
+
+		pos[left] = dims::total - 1;
+		uint64_t hi = occupancy->get(pos[0], pos[1], pos[2]);
+
+		uint64_t bits = axis < top ? occupancy->column(left, layer, t) :
+					     occupancy->column(left, t, layer);
+
+		rows[t] = { bits, lo, hi };
+	}
+}
+
+static inline uint64_t run_mask(int i, int w)
+{
+	return (w >= 64 ? ~0ull : (1ull << w) - 1) << i;
+}
+
+static inline bool row_matches(uint64_t row, const uint32_t *keys, int i,
+			       int w, uint32_t key)
+{
+	uint64_t run = run_mask(i, w);
+	if ((row & run) != run) {
+		return false;
+	}
+
+	return std::all_of(keys + i, keys + i + w,
+			   [&](uint32_t k) { return k == key; });
+}
+
+// Key flags of faces that cannot be stretched along a row or a column
+#define KEY_FIXED_W (1u << 24)
+#define KEY_FIXED_H (1u << 25)
+
+// Covers the set bits of a plane with rectangles of equal keys, growing
+// each one along the row first, and calls emit(i, j, w, h, key) for each.
+template <uint32_t size_log, typename fn>
+static void merge_plane(uint64_t *plane, const uint32_t (*keys)[1 << size_log],
+			fn &&emit)
+{
+	const int size = chunk_dims<size_log>::size;
+
+	for (int j = 0; j < size; j++) {
+		while (plane[j] != 0) {
+			int i = std::countr_zero(plane[j]);
+			uint32_t key = keys[j][i];
+
+			int w = 1, h = 1;
+			if ((key & KEY_FIXED_W) == 0) {
+				while (i + w < size &&
+				       ((plane[j] >> (i + w)) & 1) &&
+				       keys[j][i + w] == key) {
+					w++;
+				}
+			}
+
+			if ((key & KEY_FIXED_H) == 0) {
+				while (j + h < size &&
+				       row_matches(plane[j + h], keys[j + h], i,
+						   w, key)) {
+					plane[j + h] &= ~run_mask(i, w);
+					h++;
+				}
+			}
+
+			plane[j] &= ~run_mask(i, w);
+			emit(i, j, w, h, key);
+		}
+	}
+}
+
+// Working set of the greedy mesher, reused by every direction
+template <uint32_t size_log> struct greedy_scratch {
+	using dims = chunk_dims<size_log>;
+
+	// Visible faces of one direction, by layer along the normal and row
+	// along the top axis, with a bit per block along the left axis
+	uint64_t planes[dims::size][dims::size];
+	uint32_t keys[dims::size][dims::size];
+
+	// Opacity of the layer in front of the faces, by row along the top
+	// axis, halo included
+	opacity_row front[dims::total];
+};
+
+// Calls emit(face) for every merged quad of direction k
+template <uint32_t size_log, int k, typename fn>
+static void greedy_direction(const basic_chunk<size_log> *ch,
+			     const block_id *dense, const uint8_t *flags,
+			     greedy_scratch<size_log> &scratch, fn &&emit)
+{
+	using dims = chunk_dims<size_log>;
+	using chunk = basic_chunk<size_log>;
+	using dir = face_dir<size_log, k>;
+
+	const block_properties *props = blocks::get_properties();
+
+	const basic_occupancy<size_log> *occ = ch->get_occupancy();
+	const bool opaque =
+		ch->is_opaque(dims::begin, dims::begin, dims::begin);
+
+	// Position of the nine AO samples relative to the face's block, in
+	// rows of the front layer and bits of a row
+	constexpr std::array<int, 9> sample_row = dir::samples_along(dir::top);
+	constexpr std::array<int, 9> sample_shift =
+		dir::samples_along(dir::left);
+
+	uint64_t (&planes)[dims::size][dims::size] = scratch.planes;
+
+	std::fill(&planes[0][0], &planes[0][0] + dims::size * dims::size, 0);
+
+	// A face is visible where a renderable face is not covered by the one
+	// in front of it. Rows are walked along z, which is contiguous in the
+	// dense array, and eight blocks are tested at a time.
+	for (int x = 0; x < dims::size; x++) {
+		for (int y = 0; y < dims::size; y++) {
+			const uint8_t *row =
+				flags + chunk::index(x + dims::begin,
+						     y + dims::begin,
+						     dims::begin);
+
+			uint64_t visible = 0;
+			for (int z = 0; z < dims::size; z += 8) {
+				uint64_t self, next;
+				std::memcpy(&self, row + z, 8);
+				std::memcpy(&next, row + z + dir::front, 8);
+
+				// Gathers bit k of each byte into a byte
+				uint64_t bits = ((self & ~next) >> k) &
+						0x0101010101010101ull;
+				visible |= (bits * 0x0102040810204080ull >> 56)
+					   << z;
+			}
+
+			int pos[3] = { x, y, 0 };
+			if constexpr (dir::left == 2) {
+				planes[pos[dir::axis]][pos[dir::top]] = visible;
+				continue;
+			}
+
+			while (visible != 0) {
+				pos[2] = std::countr_zero(visible);
+				visible &= visible - 1;
+
+				planes[pos[dir::axis]][pos[dir::top]] |=
+					1ull << pos[dir::left];
+			}
+		}
+	}
+
+	for (int c = 0; c < dims::size; c++) {
+		const uint64_t *plane = planes[c];
+		bool empty = std::all_of(plane, plane + dims::size,
+					 [](uint64_t r) { return !r; });
+		if (empty) {
+			continue;
+		}
+
+		int pos[3];
+		pos[dir::axis] = c + dims::begin;
+
+		constexpr int d[3] = { c_dx[k], c_dy[k], c_dz[k] };
+		load_layer<size_log>(occ, opaque, dir::axis, dir::left,
+				     dir::top, pos[dir::axis] + d[dir::axis],
+				     scratch.front);
+
+		for (int j = 0; j < dims::size; j++) {
+			uint64_t row = planes[c][j];
+			if (row == 0) {
+				continue;
+			}
+
+			uint64_t words[9];
+			for (int b = 0; b < 9; b++) {
+				words[b] = shift_row<size_log>(
+					scratch.front[j + dims::begin +
+						      sample_row[b]],
+					sample_shift[b]);
+			}
+
+			uint8_t lo[64], hi[64];
+			gather_ao_indices(words, lo, hi);
+
+			while (row != 0) {
+				int i = std::countr_zero(row);
+				row &= row - 1;
+
+				pos[dir::left] = i + dims::begin;
+				pos[dir::top] = j + dims::begin;
+
+				block_id id = dense[chunk::index(
+					pos[0], pos[1], pos[2])];
+				uint8_t ao = c_ao[lo[i] | hi[i] << 8];
+
+				// AO is interpolated across the quad, so it
+				// may only be stretched along an axis the AO
+				// does not vary on
+				int base = ao & 3, l = (ao >> 2) & 3,
+				    lt = (ao >> 4) & 3, t = (ao >> 6) & 3;
+
+				uint32_t key = props->get_face(id, dir::face) |
+					       ao << 16;
+				if (base != l || t != lt) {
+					key |= KEY_FIXED_W;
+				}
+
+				if (base != t || l != lt) {
+					key |= KEY_FIXED_H;
+				}
+
+				scratch.keys[j][i] = key;
+			}
+		}
+
+		merge_plane<size_log>(
+			planes[c], scratch.keys,
+			[&](int i, int j, int w, int h, uint32_t key) {
+				pos[dir::left] = i + dims::begin;
+				pos[dir::top] = j + dims::begin;
+
+				face_draw_data face;
+				face.face = key & 0xffff;
+				face.normal = dir::face;
+				face.ao = (key >> 16) & 0xff;
+				face.x = pos[0];
+				face.y = pos[1];
+				face.z = pos[2];
+				face.w = w;
+				face.h = h;
+
+				emit(face);
+			});
+	}
+}
+
+// Calls emit(face) for every merged quad, one normal after the other
+template <uint32_t size_log, typename fn>
+static void greedy_faces(const basic_chunk<size_log> *ch, fn &&emit)
+{
+	using dims = chunk_dims<size_log>;
+
+	if (ch->is_uniform()) {
+		return;
+	}
+
+	const size_t count = dims::total * dims::total * dims::total;
+
+	scratch_scope scratch;
+
+	block_id *dense = scratch.allocate<block_id>(count);
+	ch->unpack(dense);
+
+	uint8_t *flags = scratch.allocate<uint8_t>(count);
+	load_flags(dense, count, flags);
+
+	greedy_scratch<size_log> *work =
+		scratch.allocate<greedy_scratch<size_log> >(1);
+
+	for_each_face([&](auto k) {
+		greedy_direction<size_log, decltype(k)::value>(
+			ch, dense, flags, *work, emit);
+	});
+}
+
+template <uint32_t size_log>
+chunk_draw_data basic_greedy_chunk_draw_data_generator<size_log>::generate(
+	const basic_chunk<size_log> *ch) const
+{
+	scratch_scope scratch;
+
+	// Staged so the result is allocated once, at its final size
+	face_draw_data *faces = scratch.allocate<face_draw_data>(
+		chunk_dims<size_log>::max_faces);
+	size_t count = 0;
+
+	greedy_faces<size_log>(
+		ch, [&](const face_draw_data &face) { faces[count++] = face; });
+
+	chunk_draw_data data;
+	data.faces.assign(faces, faces + count);
+	return data;
+}
+
+template <uint32_t size_log>
+void basic_greedy_chunk_draw_data_generator<size_log>::generate(
+	const basic_chunk<size_log> *ch, basic_face_sink<size_log> &sink) const
+{
+	greedy_faces<size_log>(
+		ch, [&](const face_draw_data &face) { sink.push(face); });
+}
+
+template <uint32_t size_log>
+uint8_t patch_mesh(const basic_chunk<size_log> *ch, int x, int y, int z,
+		   chunk_mesh &mesh)
+{
+	using dims = chunk_dims<size_log>;
+
+	mesh.content.clear();
+
+	// The blocks whose faces or AO the edited block can affect
+	const int block[3] = { x, y, z };
+	int lo[3], hi[3];
+	for (int a = 0; a < 3; a++) {
+		lo[a] = std::max(block[a] - 1, dims::begin);
+		hi[a] = std::min(block[a] + 2, dims::end);
+
+		if (lo[a] >= hi[a]) {
+			return 0;
+		}
+	}
+
+	const block_properties *props = blocks::get_properties();
+	auto opaque = [&](int ox, int oy, int oz) {
+		return ch->is_opaque(ox, oy, oz);
+	};
+
+	// Swapped with the mesh's storage at the end, so steady patching
+	// allocates nothing
+	thread_local std::vector<packed_face> faces;
+	faces.clear();
+	faces.reserve(mesh.faces.size() + 64);
+
+	uint8_t changed = 0;
+	uint32_t offset = 0;
 
-	face_registry *freg = faces::get_registry();
-	block_registry *breg = blocks::get_registry();
 	for (int k = 0; k < 6; k++) {
 		block_face kf = static_cast<block_face>(k);
-		for (int x = CHUNK_BEGIN; x < CHUNK_END; x++) {
-			for (int y = CHUNK_BEGIN; y < CHUNK_END; y++) {
-				for (int z = CHUNK_BEGIN; z < CHUNK_END; z++) {
-					int nx = x + dx[k], ny = y + dy[k],
-					    nz = z + dz[k];
 
-					face_id faceid =
-						breg->get(ch->get(x, y, z))
-							->get_face(kf);
+		const int axis = k >> 1;
+		const int left = c_quad_left[k];
+		const int top = c_quad_top[k];
 
-					face_id nfaceid =
-						breg->get(ch->get(nx, ny, nz))
-							->get_face(kf);
+		const uint32_t first = faces.size();
+		bool touched = false;
 
-					face *f = freg->get(faceid);
-					face *nf = freg->get(nfaceid);
+		// Range of the packed coordinate along the normal to look at
+		const uint32_t shift = axis * size_log;
+		const uint32_t layer_lo = lo[axis] - dims::begin;
+		const uint32_t layer_hi = hi[axis] - dims::begin;
 
-					if (f->get_texture() == nullptr ||
-					    nf->get_texture() != nullptr) {
-						continue;
-					}
+		const packed_face *src = mesh.faces.data();
+		const uint32_t end = offset + mesh.counts[k];
+
+		// Faces outside the layers are copied over in runs
+		uint32_t run = offset;
+		for (uint32_t i = offset; i < end; i++) {
+			uint32_t layer =
+				(src[i].geometry >> shift) & (dims::size - 1);
+			if (layer < layer_lo || layer >= layer_hi) {
+				continue;
+			}
+
+			faces.insert(faces.end(), src + run, src + i);
+			run = i + 1;
+
+			face_draw_data face = unpack_face<size_log>(src[i]);
+			face.normal = kf;
+
+			int pos[3] = { face.x, face.y, face.z };
+			const int l0 = pos[left], l1 = l0 + face.w;
+			const int t0 = pos[top], t1 = t0 + face.h;
+
+			if (l1 <= lo[left] || l0 >= hi[left] ||
+			    t1 <= lo[top] || t0 >= hi[top]) {
+				faces.push_back(src[i]);
+				continue;
+			}
+
+			touched = true;
+
+			// A quad has the same face and AO throughout, so the
+			// parts of it outside the box stay valid
+			auto keep = [&](int a0, int a1, int b0, int b1) {
+				if (a0 >= a1 || b0 >= b1) {
+					return;
+				}
+
+				pos[left] = a0;
+				pos[top] = b0;
+
+				face.x = pos[0];
+				face.y = pos[1];
+				face.z = pos[2];
+				face.w = a1 - a0;
+				face.h = b1 - b0;
+
+				faces.push_back(pack_face<size_log>(face));
+			};
 
-					uint16_t mask = 0;
+			const int m0 = std::max(t0, lo[top]);
+			const int m1 = std::min(t1, hi[top]);
 
-					int di = -1, dj = -1, bit = 1;
-					while (di <= 1) {
-						int nnx = nx + dleftx[k] * di +
-							  dtopx[k] * dj,
-						    nny = ny + dlefty[k] * di +
-							  dtopy[k] * dj,
-						    nnz = nz + dleftz[k] * di +
-							  dtopz[k] * dj;
+			keep(l0, l1, t0, std::min(t1, lo[top]));
+			keep(l0, l1, std::max(t0, hi[top]), t1);
+			keep(l0, std::min(l1, lo[left]), m0, m1);
+			keep(std::max(l0, hi[left]), l1, m0, m1);
+		}
 
-						block *block = breg->get(
-							ch->get(nnx, nny, nnz));
+		faces.insert(faces.end(), src + run, src + end);
+		offset = end;
 
-						if (block->is_opaque()) {
-							mask |= bit;
-						}
+		// The faces inside the box, unmerged
+		for (int px = lo[0]; px < hi[0]; px++) {
+			for (int py = lo[1]; py < hi[1]; py++) {
+				for (int pz = lo[2]; pz < hi[2]; pz++) {
+					int nx = px + c_dx[k];
+					int ny = py + c_dy[k];
+					int nz = pz + c_dz[k];
 
-						if (++dj > 1) {
-							di++;
-							dj = -1;
-						}
+					face_id faceid = props->get_face(
+						ch->get(px, py, pz), kf);
+					face_id nfaceid = props->get_face(
+						ch->get(nx, ny, nz), kf);
 
-						bit <<= 1;
+					if (!props->is_renderable(faceid) ||
+					    props->is_renderable(nfaceid)) {
+						continue;
 					}
 
-					data.faces.emplace_back(faceid, kf,
-								c_ao[mask], x,
-								y, z);
+					uint8_t ao =
+						face_ao(opaque, k, nx, ny, nz);
+
+					faces.push_back(pack_face<size_log>(
+						face_draw_data(faceid, kf, ao,
+							       px, py, pz)));
+					touched = true;
 				}
 			}
 		}
+
+		if (touched) {
+			changed |= 1 << k;
+		}
+
+		mesh.counts[k] = faces.size() - first;
 	}
 
-	return data;
+	mesh.faces.swap(faces);
+	return changed;
 }
+
+template class basic_occupancy<4>;
+template class basic_occupancy<5>;
+template class basic_occupancy<6>;
+
+template class basic_chunk<4>;
+template class basic_chunk<5>;
+template class basic_chunk<6>;
+
+template class basic_simple_chunk_draw_data_generator<4>;
+template class basic_simple_chunk_draw_data_generator<5>;
+template class basic_simple_chunk_draw_data_generator<6>;
+
+template class basic_greedy_chunk_draw_data_generator<4>;
+template class basic_greedy_chunk_draw_data_generator<5>;
+template class basic_greedy_chunk_draw_data_generator<6>;
+
+template uint8_t patch_mesh<4>(const basic_chunk<4> *, int, int, int,
+			       chunk_mesh &);
+template uint8_t patch_mesh<5>(const basic_chunk<5> *, int, int, int,
+			       chunk_mesh &);
+template uint8_t patch_mesh<6>(const basic_chunk<6> *, int, int, int,
+			       chunk_mesh &);
 }
 }
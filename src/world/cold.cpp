@@ -0,0 +1,114 @@
+#include "mineclonelib/world/cold.h"
+
+#include <chrono>
+
+namespace mc
+{
+namespace world
+{
+std::atomic<uint32_t> access_clock(0);
+
+static const auto clock_start = std::chrono::steady_clock::now();
+
+void advance_access_clock()
+{
+	auto elapsed = std::chrono::steady_clock::now() - clock_start;
+	access_clock.store(
+		std::chrono::duration_cast<std::chrono::seconds>(elapsed)
+			.count(),
+		std::memory_order_relaxed);
+}
+
+cold_tier_counters &get_cold_tier_counters()
+{
+	static cold_tier_counters counters;
+	return counters;
+}
+
+cold_tier_stats get_cold_tier_stats()
+{
+	cold_tier_counters &c = get_cold_tier_counters();
+	return { c.compressed.load(), c.decompressed.load(),
+		 c.raw_bytes.load(), c.compressed_bytes.load(),
+		 c.decompress_ns.load(), c.decompress_max_ns.load() };
+}
+
+void record_decompression(uint64_t ns)
+{
+	cold_tier_counters &c = get_cold_tier_counters();
+	c.decompressed++;
+	c.decompress_ns += ns;
+
+	uint64_t max = c.decompress_max_ns.load(std::memory_order_relaxed);
+	while (max < ns && !c.decompress_max_ns.compare_exchange_weak(
+				   max, ns, std::memory_order_relaxed)) {
+	}
+}
+
+cold_tier::cold_tier()
+	: m_run(true)
+{
+}
+
+cold_tier::~cold_tier()
+{
+	{
+		std::lock_guard lock(m_mutex);
+		m_run = false;
+	}
+
+	m_cv.notify_one();
+	if (m_thread.joinable()) {
+		m_thread.join();
+	}
+}
+
+void cold_tier::submit(job &&j)
+{
+	// Started on first use, so a disabled cold tier costs no thread
+	if (!m_thread.joinable()) {
+		m_thread = std::thread(&cold_tier::run, this);
+	}
+
+	{
+		std::lock_guard lock(m_mutex);
+		m_queue.emplace_back(std::move(j));
+	}
+
+	m_cv.notify_one();
+}
+
+void cold_tier::collect(std::vector<job> &done)
+{
+	std::lock_guard lock(m_mutex);
+	for (job &j : m_done) {
+		done.emplace_back(std::move(j));
+	}
+
+	m_done.clear();
+}
+
+void cold_tier::run()
+{
+	while (true) {
+		std::unique_lock lock(m_mutex);
+		m_cv.wait(lock, [&] { return !m_run || !m_queue.empty(); });
+
+		if (!m_run) {
+			break;
+		}
+
+		job j = std::move(m_queue.front());
+		m_queue.pop_front();
+
+		lock.unlock();
+
+		j.storage.encode(j.compressed);
+		j.compressed.shrink_to_fit();
+
+		lock.lock();
+		m_done.emplace_back(std::move(j));
+	}
+}
+}
+}
@@ -0,0 +1,211 @@
+#include "mineclonelib/world/compression.h"
+
+#include <cstring>
+
+#define LZ_MIN_MATCH 4
+#define LZ_WINDOW 65535
+#define LZ_HASH_LOG 12
+
+namespace mc
+{
+namespace world
+{
+void write_varint(std::vector<uint8_t> &out, uint32_t value)
+{
+	while (value >= 0x80) {
+		out.push_back(static_cast<uint8_t>(value) | 0x80);
+		value >>= 7;
+	}
+
+	out.push_back(static_cast<uint8_t>(value));
+}
+
+bool read_varint(const uint8_t *&src, const uint8_t *end, uint32_t &value)
+{
+	value = 0;
+	for (int shift = 0; shift < 35; shift += 7) {
+		if (src == end) {
+			return false;
+		}
+
+		uint8_t byte = *src++;
+		value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+
+		if ((byte & 0x80) == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static inline uint32_t read32(const uint8_t *p)
+{
+	uint32_t v;
+	std::memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t lz_hash(uint32_t v)
+{
+	return (v * 2654435761u) >> (32 - LZ_HASH_LOG);
+}
+
+// Lengths that overflow a token nibble continue in 255-valued bytes
+static void write_length(std::vector<uint8_t> &out, size_t length)
+{
+	while (length >= 255) {
+		out.push_back(255);
+		length -= 255;
+	}
+
+	out.push_back(static_cast<uint8_t>(length));
+}
+
+static bool read_length(const uint8_t *&src, const uint8_t *end,
+			size_t &length)
+{
+	uint8_t byte;
+	do {
+		if (src == end) {
+			return false;
+		}
+
+		byte = *src++;
+		length += byte;
+	} while (byte == 255);
+
+	return true;
+}
+
+static void write_sequence(std::vector<uint8_t> &out, const uint8_t *literals,
+			   size_t literal_count, size_t offset, size_t match)
+{
+	size_t match_code = (match != 0 ? match - LZ_MIN_MATCH : 0);
+
+	uint8_t token = (literal_count < 15 ? literal_count : 15) << 4 |
+			(match_code < 15 ? match_code : 15);
+	out.push_back(token);
+
+	if (literal_count >= 15) {
+		write_length(out, literal_count - 15);
+	}
+
+	out.insert(out.end(), literals, literals + literal_count);
+
+	if (match == 0) {
+		return;
+	}
+
+	out.push_back(static_cast<uint8_t>(offset));
+	out.push_back(static_cast<uint8_t>(offset >> 8));
+
+	if (match_code >= 15) {
+		write_length(out, match_code - 15);
+	}
+}
+
+void lz_compress(const uint8_t *src, size_t size, std::vector<uint8_t> &out)
+{
+	int64_t table[1 << LZ_HASH_LOG];
+	for (int64_t &entry : table) {
+		entry = -1;
+	}
+
+	size_t anchor = 0;
+	size_t i = 0;
+
+	while (i + LZ_MIN_MATCH <= size) {
+		uint32_t v = read32(src + i);
+		uint32_t h = lz_hash(v);
+
+		int64_t candidate = table[h];
+		table[h] = i;
+
+		if (candidate < 0 || i - candidate > LZ_WINDOW ||
+		    read32(src + candidate) != v) {
+			i++;
+			continue;
+		}
+
+		size_t match = LZ_MIN_MATCH;
+		while (i + match < size &&
+		       src[candidate + match] == src[i + match]) {
+			match++;
+		}
+
+		write_sequence(out, src + anchor, i - anchor, i - candidate,
+			       match);
+
+		i += match;
+		anchor = i;
+	}
+
+	// The stream always ends with a literal-only sequence
+	write_sequence(out, src + anchor, size - anchor, 0, 0);
+}
+
+bool lz_decompress(const uint8_t *src, size_t src_size, uint8_t *dst,
+		   size_t size)
+{
+	const uint8_t *end = src + src_size;
+	size_t pos = 0;
+
+	// Only the closing literal-only sequence ends the stream, so a stream
+	// cut after a match is rejected rather than taken as complete
+	while (true) {
+		if (src == end) {
+			return false;
+		}
+
+		uint8_t token = *src++;
+
+		size_t literals = token >> 4;
+		if (literals == 15 && !read_length(src, end, literals)) {
+			return false;
+		}
+
+		if (literals > static_cast<size_t>(end - src) ||
+		    literals > size - pos) {
+			return false;
+		}
+
+		std::memcpy(dst + pos, src, literals);
+		src += literals;
+		pos += literals;
+
+		if (src == end) {
+			break;
+		}
+
+		if (end - src < 2) {
+			return false;
+		}
+
+		size_t offset = src[0] | (src[1] << 8);
+		src += 2;
+
+		size_t match = token & 15;
+		if (match == 15 && !read_length(src, end, match)) {
+			return false;
+		}
+
+		match += LZ_MIN_MATCH;
+
+		if (offset == 0 || offset > pos || match > size - pos) {
+			return false;
+		}
+
+		// Matches may overlap their own output, so copy byte by byte
+		const uint8_t *from = dst + pos - offset;
+		for (size_t j = 0; j < match; j++) {
+			dst[pos + j] = from[j];
+		}
+
+		pos += match;
+	}
+
+	return pos == size;
+}
+}
+}
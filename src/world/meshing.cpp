@@ -0,0 +1,305 @@
+#include "mineclonelib/world/meshing.h"
+#include "mineclonelib/world/arena.h"
+#include "mineclonelib/cvar.h"
+
+#include <algorithm>
+
+#include <taskflow/core/executor.hpp>
+
+static mc::cvar<uint32_t> mesh_jobs(
+	0, "world/mesh_jobs",
+	"The maximum number of chunks meshed in parallel, 0 for half the task workers");
+
+namespace mc
+{
+namespace world
+{
+meshing_service::meshing_service(
+	tf::Executor *executor,
+	std::unique_ptr<chunk_draw_data_generator> generator)
+	: m_executor(executor)
+	, m_generator(std::move(generator))
+	, m_prune_at(64)
+	, m_ticket(0)
+	, m_queued(0)
+	, m_running(0)
+	, m_camera(0.0f)
+{
+	m_max_running = mesh_jobs.get();
+	if (m_max_running == 0) {
+		size_t workers = m_executor->num_workers();
+		m_max_running = std::max<size_t>(workers / 2, 1);
+	}
+
+	m_meshes.reserve(m_prune_at);
+}
+
+meshing_service::~meshing_service()
+{
+	std::unique_lock lock(m_mutex);
+
+	m_queue.clear();
+	m_latest.clear();
+	m_queued = 0;
+
+	m_idle.wait(lock, [&] { return m_running == 0; });
+}
+
+void meshing_service::request(const std::shared_ptr<world_snapshot> &snapshot,
+			      const glm::ivec3 &coords)
+{
+	const chunk *ch = snapshot->get_chunk(coords);
+	if (ch == nullptr) {
+		return;
+	}
+
+	uint64_t key = pack_coords(coords);
+	uint32_t generation = ch->get_generation();
+
+	std::lock_guard lock(m_mutex);
+
+	auto it = m_latest.find(key);
+	if (it != m_latest.end()) {
+		if (it->second.generation == generation) {
+			return;
+		}
+
+		// The superseded job stays in the heap until popped
+		if (it->second.queued) {
+			m_queued--;
+		}
+	}
+
+	uint64_t ticket = ++m_ticket;
+	m_latest[key] = { ticket, generation, true };
+	m_queued++;
+
+	m_queue.push_back(
+		{ distance_to(coords), ticket, key, coords, generation,
+		  snapshot });
+	std::push_heap(m_queue.begin(), m_queue.end(), further);
+
+	// Room for every job in flight, so workers never grow the completion
+	// queue
+	size_t needed = m_completed.size() + m_queued + m_running;
+	if (m_completed.capacity() < needed) {
+		m_completed.reserve(
+			std::max(needed, m_completed.capacity() * 2));
+	}
+
+	dispatch();
+}
+
+void meshing_service::cancel(const glm::ivec3 &coords)
+{
+	std::lock_guard lock(m_mutex);
+
+	auto it = m_latest.find(pack_coords(coords));
+	if (it == m_latest.end()) {
+		return;
+	}
+
+	if (it->second.queued) {
+		m_queued--;
+	}
+
+	m_latest.erase(it);
+}
+
+void meshing_service::set_view(const glm::mat4 &view)
+{
+	glm::vec3 camera = glm::vec3(glm::inverse(view)[3]);
+
+	std::lock_guard lock(m_mutex);
+
+	glm::vec3 moved = camera - m_camera;
+	if (glm::dot(moved, moved) < 1.0f) {
+		return;
+	}
+
+	m_camera = camera;
+
+	// Drop superseded jobs while re-keying the heap
+	size_t count = 0;
+	for (job &j : m_queue) {
+		auto it = m_latest.find(j.key);
+		if (it == m_latest.end() || it->second.ticket != j.ticket) {
+			continue;
+		}
+
+		j.distance = distance_to(j.coords);
+		m_queue[count++] = std::move(j);
+	}
+
+	m_queue.erase(m_queue.begin() + count, m_queue.end());
+	std::make_heap(m_queue.begin(), m_queue.end(), further);
+}
+
+size_t meshing_service::collect(std::vector<result> &out, size_t max)
+{
+	std::lock_guard lock(m_mutex);
+
+	size_t count = 0;
+	size_t idx = 0;
+	for (; idx < m_completed.size() && count < max; idx++) {
+		completed &c = m_completed[idx];
+
+		auto it = m_latest.find(pack_coords(c.res.coords));
+		if (it == m_latest.end() || it->second.ticket != c.ticket) {
+			continue;
+		}
+
+		m_latest.erase(it);
+		out.emplace_back(std::move(c.res));
+		count++;
+	}
+
+	m_completed.erase(m_completed.begin(), m_completed.begin() + idx);
+	return count;
+}
+
+size_t meshing_service::get_queued() const
+{
+	std::lock_guard lock(m_mutex);
+	return m_queued;
+}
+
+float meshing_service::distance_to(const glm::ivec3 &coords) const noexcept
+{
+	glm::vec3 center = (glm::vec3(coords) + 0.5f) *
+			   static_cast<float>(CHUNK_SIZE);
+
+	glm::vec3 delta = center - m_camera;
+	return glm::dot(delta, delta);
+}
+
+bool meshing_service::further(const job &a, const job &b) noexcept
+{
+	return a.distance > b.distance;
+}
+
+bool meshing_service::pop(job &j)
+{
+	while (!m_queue.empty()) {
+		std::pop_heap(m_queue.begin(), m_queue.end(), further);
+		j = std::move(m_queue.back());
+		m_queue.pop_back();
+
+		auto it = m_latest.find(j.key);
+		if (it != m_latest.end() && it->second.ticket == j.ticket) {
+			it->second.queued = false;
+			m_queued--;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void meshing_service::dispatch()
+{
+	while (m_running < m_max_running && m_running < m_queued) {
+		m_running++;
+		m_executor->silent_async([this] { run(); });
+	}
+}
+
+std::shared_ptr<const chunk_mesh> meshing_service::find_mesh(uint64_t hash)
+{
+	std::lock_guard lock(m_mutex);
+
+	auto it = m_meshes.find(hash);
+	if (it == m_meshes.end()) {
+		return nullptr;
+	}
+
+	return it->second.lock();
+}
+
+std::shared_ptr<const chunk_mesh>
+meshing_service::generate(const chunk *ch,
+			  const std::vector<uint8_t> &content) const
+{
+	scratch_scope scratch;
+
+	// Sized for the worst case, of which a mesh only touches the start
+	face_sink sink(scratch.allocate<packed_face>(
+		chunk_dims<CHUNK_SIZE_LOG>::max_faces));
+	m_generator->generate(ch, sink);
+
+	std::shared_ptr<chunk_mesh> mesh = std::make_shared<chunk_mesh>();
+	mesh->faces.assign(sink.data(), sink.data() + sink.size());
+	for (int n = 0; n < 6; n++) {
+		mesh->counts[n] = sink.get_count(static_cast<block_face>(n));
+	}
+
+	mesh->content = content;
+	return mesh;
+}
+
+void meshing_service::prune_meshes()
+{
+	std::erase_if(m_meshes,
+		      [](const auto &entry) { return entry.second.expired(); });
+
+	m_prune_at = std::max<size_t>(m_meshes.size() * 2, 64);
+
+	// The map is pruned before it outgrows its buckets, so inserting a
+	// mesh never rehashes on a worker
+	m_meshes.reserve(m_prune_at);
+}
+
+void meshing_service::run()
+{
+	// Jobs are taken in a loop rather than posted one task each, so a
+	// worker allocates nothing once the mesh cache is warm
+	job j;
+	for (;;) {
+		{
+			std::lock_guard lock(m_mutex);
+			if (!pop(j)) {
+				m_running--;
+				m_idle.notify_all();
+				return;
+			}
+		}
+
+		const chunk *ch = j.snapshot->get_chunk(j.coords);
+
+		// Reused, like the scratch arena
+		thread_local std::vector<uint8_t> content;
+		content.clear();
+		ch->encode_content(content);
+
+		// A hash match is only shared once the blocks are known to be
+		// equal. A chunk colliding with a cached mesh gets a mesh of
+		// its own, which is not cached.
+		uint64_t hash = ch->content_hash();
+		result res = { j.coords, j.generation, hash, find_mesh(hash) };
+		if (res.mesh == nullptr || res.mesh->content != content) {
+			bool collided = res.mesh != nullptr;
+			res.mesh = generate(ch, content);
+
+			std::lock_guard lock(m_mutex);
+			if (!collided) {
+				m_meshes[res.hash] = res.mesh;
+			}
+
+			if (m_meshes.size() >= m_prune_at) {
+				prune_meshes();
+			}
+		}
+
+		// Unpins the snapshot before the next job is picked up
+		j.snapshot.reset();
+
+		std::lock_guard lock(m_mutex);
+
+		auto it = m_latest.find(j.key);
+		if (it != m_latest.end() && it->second.ticket == j.ticket) {
+			m_completed.push_back({ j.ticket, std::move(res) });
+		}
+	}
+}
+}
+}
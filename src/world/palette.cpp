@@ -0,0 +1,258 @@
+#include "mineclonelib/world/palette.h"
+#include "mineclonelib/world/compression.h"
+
+#include <algorithm>
+
+namespace mc
+{
+namespace world
+{
+static uint32_t word_count(uint32_t size, uint32_t bits)
+{
+	if (bits == 0) {
+		return 1;
+	}
+
+	return (static_cast<uint64_t>(size) * bits + 63) >> 6;
+}
+
+static uint32_t bits_for(size_t palette_size)
+{
+	if (palette_size <= 1) {
+		return 0;
+	}
+
+	uint32_t bits = 1;
+	while ((1ull << bits) < palette_size) {
+		bits <<= 1;
+	}
+
+	return bits;
+}
+
+palette_storage::palette_storage(uint32_t size, block_id fill)
+	: m_size(size)
+	, m_bits(0)
+	, m_mask(0)
+	, m_last(0)
+	, m_palette{ fill }
+	, m_words(1, 0)
+{
+}
+
+void palette_storage::unpack(block_id *dst) const noexcept
+{
+	if (m_bits == 0) {
+		std::fill(dst, dst + m_size, m_palette[0]);
+		return;
+	}
+
+	uint32_t per_word = 64 / m_bits;
+
+	uint32_t idx = 0;
+	for (uint32_t w = 0; idx < m_size; w++) {
+		uint64_t word = m_words[w];
+		for (uint32_t i = 0; i < per_word && idx < m_size; i++) {
+			dst[idx++] = m_palette[word & m_mask];
+			word >>= m_bits;
+		}
+	}
+}
+
+void palette_storage::fill(block_id block)
+{
+	m_palette.assign(1, block);
+	m_words.assign(1, 0);
+	m_words.shrink_to_fit();
+
+	m_bits = 0;
+	m_mask = 0;
+	m_last = 0;
+}
+
+void palette_storage::compact()
+{
+	if (m_bits == 0) {
+		return;
+	}
+
+	std::vector<bool> used(m_palette.size(), false);
+	for (uint32_t idx = 0; idx < m_size; idx++) {
+		uint32_t bit = idx * m_bits;
+		used[(m_words[bit >> 6] >> (bit & 63)) & m_mask] = true;
+	}
+
+	std::vector<uint32_t> remap(m_palette.size(), 0);
+	std::vector<block_id> palette;
+	for (uint32_t i = 0; i < m_palette.size(); i++) {
+		if (used[i]) {
+			remap[i] = palette.size();
+			palette.push_back(m_palette[i]);
+		}
+	}
+
+	if (palette.size() == m_palette.size()) {
+		return;
+	}
+
+	repack(bits_for(palette.size()), remap.data());
+	m_palette = std::move(palette);
+	m_last = 0;
+}
+
+void palette_storage::encode(std::vector<uint8_t> &out) const
+{
+	write_varint(out, m_palette.size());
+	for (block_id block : m_palette) {
+		write_varint(out, block);
+	}
+
+	std::vector<uint8_t> runs;
+
+	uint32_t idx = 0;
+	while (idx < m_size) {
+		uint32_t bit = idx * m_bits;
+		uint64_t local = (m_words[bit >> 6] >> (bit & 63)) & m_mask;
+
+		uint32_t run = 1;
+		for (; idx + run < m_size; run++) {
+			uint32_t next = (idx + run) * m_bits;
+			if (((m_words[next >> 6] >> (next & 63)) & m_mask) !=
+			    local) {
+				break;
+			}
+		}
+
+		write_varint(runs, local);
+		write_varint(runs, run);
+		idx += run;
+	}
+
+	write_varint(out, runs.size());
+	lz_compress(runs.data(), runs.size(), out);
+}
+
+bool palette_storage::decode(const uint8_t *data, size_t size)
+{
+	const uint8_t *src = data;
+	const uint8_t *end = data + size;
+
+	uint32_t count;
+	if (!read_varint(src, end, count) || count == 0) {
+		return false;
+	}
+
+	std::vector<block_id> palette(count);
+	for (block_id &block : palette) {
+		uint32_t value;
+		if (!read_varint(src, end, value)) {
+			return false;
+		}
+
+		block = value;
+	}
+
+	uint32_t runs_size;
+	if (!read_varint(src, end, runs_size)) {
+		return false;
+	}
+
+	std::vector<uint8_t> runs(runs_size);
+	if (!lz_decompress(src, end - src, runs.data(), runs_size)) {
+		return false;
+	}
+
+	uint32_t bits = bits_for(count);
+	std::vector<uint64_t> words(word_count(m_size, bits), 0);
+
+	src = runs.data();
+	end = runs.data() + runs.size();
+
+	uint32_t idx = 0;
+	while (src != end) {
+		uint32_t local, run;
+		if (!read_varint(src, end, local) ||
+		    !read_varint(src, end, run) || local >= count ||
+		    run > m_size - idx) {
+			return false;
+		}
+
+		for (uint32_t i = 0; i < run && bits != 0; i++) {
+			uint32_t bit = (idx + i) * bits;
+			words[bit >> 6] |= static_cast<uint64_t>(local)
+					   << (bit & 63);
+		}
+
+		idx += run;
+	}
+
+	if (idx != m_size) {
+		return false;
+	}
+
+	m_palette = std::move(palette);
+	m_words = std::move(words);
+	m_bits = bits;
+	m_mask = (1ull << bits) - 1;
+	m_last = 0;
+
+	return true;
+}
+
+void palette_storage::release()
+{
+	m_words = std::vector<uint64_t>();
+}
+
+size_t palette_storage::memory_usage() const noexcept
+{
+	return sizeof(*this) + m_palette.capacity() * sizeof(block_id) +
+	       m_words.capacity() * sizeof(uint64_t);
+}
+
+uint32_t palette_storage::find_or_insert(block_id block)
+{
+	for (uint32_t i = 0; i < m_palette.size(); i++) {
+		if (m_palette[i] == block) {
+			m_last = i;
+			return i;
+		}
+	}
+
+	uint32_t local = m_palette.size();
+	m_palette.push_back(block);
+
+	if (local > m_mask) {
+		repack(bits_for(m_palette.size()), nullptr);
+	}
+
+	m_last = local;
+	return local;
+}
+
+void palette_storage::repack(uint32_t bits, const uint32_t *remap)
+{
+	std::vector<uint64_t> words(word_count(m_size, bits), 0);
+
+	if (bits != 0) {
+		for (uint32_t idx = 0; idx < m_size; idx++) {
+			uint32_t old_bit = idx * m_bits;
+			uint64_t local =
+				(m_words[old_bit >> 6] >> (old_bit & 63)) &
+				m_mask;
+
+			if (remap != nullptr) {
+				local = remap[local];
+			}
+
+			uint32_t bit = idx * bits;
+			words[bit >> 6] |= local << (bit & 63);
+		}
+	}
+
+	m_words = std::move(words);
+	m_bits = bits;
+	m_mask = (1ull << bits) - 1;
+}
+}
+}
@@ -1,8 +1,450 @@
 #include "mineclonelib/world/world.h"
+#include "mineclonelib/world/blocks.h"
+#include "mineclonelib/cvar.h"
+#include "mineclonelib/log.h"
+
+#include <algorithm>
+
+static mc::cvar<uint32_t>
+	cold_after(30, "world/cold_after",
+		   "Seconds without access before a chunk is compressed, 0 disables");
 
 namespace mc
 {
 namespace world
 {
+chunk_map::chunk_map()
+	: m_slots(16, slot{ 0, 0 })
+	, m_mask(15)
+	, m_size(0)
+{
+}
+
+void chunk_map::insert(uint64_t key, chunk_arena::handle handle)
+{
+	// Keep the load factor at or below 1/2
+	if ((m_size + 1) * 2 > m_slots.size()) {
+		rehash(m_slots.size() * 2);
+	}
+
+	uint32_t idx = hash(key) & m_mask;
+	while (m_slots[idx].handle != 0) {
+		if (m_slots[idx].key == key) {
+			m_slots[idx].handle = handle;
+			return;
+		}
+
+		idx = (idx + 1) & m_mask;
+	}
+
+	m_slots[idx] = { key, handle };
+	m_size++;
+}
+
+chunk_arena::handle chunk_map::erase(uint64_t key)
+{
+	uint32_t idx = hash(key) & m_mask;
+	while (m_slots[idx].handle != 0 && m_slots[idx].key != key) {
+		idx = (idx + 1) & m_mask;
+	}
+
+	chunk_arena::handle handle = m_slots[idx].handle;
+	if (handle == 0) {
+		return 0;
+	}
+
+	// Shift back later entries of the probe run so lookups never stop at
+	// the hole
+	uint32_t hole = idx;
+	for (uint32_t next = (hole + 1) & m_mask; m_slots[next].handle != 0;
+	     next = (next + 1) & m_mask) {
+		uint32_t home = hash(m_slots[next].key) & m_mask;
+		if (((next - home) & m_mask) >= ((next - hole) & m_mask)) {
+			m_slots[hole] = m_slots[next];
+			hole = next;
+		}
+	}
+
+	m_slots[hole] = { 0, 0 };
+	m_size--;
+
+	return handle;
+}
+
+void chunk_map::rehash(uint32_t capacity)
+{
+	std::vector<slot> slots(capacity, slot{ 0, 0 });
+	std::swap(slots, m_slots);
+
+	m_mask = capacity - 1;
+	m_size = 0;
+
+	for (const slot &s : slots) {
+		if (s.handle != 0) {
+			insert(s.key, s.handle);
+		}
+	}
+}
+
+world_state::world_state()
+	: m_cold_next(1)
+	, m_epoch(1)
+	, m_last_coords(0, 0, 0)
+	, m_last(nullptr)
+{
+}
+
+world_state::~world_state()
+{
+	std::lock_guard lock(m_pin_mutex);
+	LOG_ASSERT(Default, m_pins.empty(),
+		   "World destroyed while snapshots of it are alive");
+}
+
+chunk *world_state::load_chunk(const glm::ivec3 &coords, block_id fill)
+{
+	uint64_t key = pack_coords(coords);
+
+	chunk_arena::handle handle = m_chunks.find(key);
+	if (handle != 0) {
+		return m_arena.get(handle);
+	}
+
+	handle = m_arena.alloc(fill);
+	m_chunks.insert(key, handle);
+
+	chunk *ch = m_arena.get(handle);
+	ch->set_epoch(m_epoch);
+	link_neighbours(coords, ch);
+
+	return ch;
+}
+
+void world_state::unload_chunk(const glm::ivec3 &coords)
+{
+	uint64_t key = pack_coords(coords);
+
+	chunk_arena::handle handle = m_chunks.erase(key);
+	if (handle == 0) {
+		return;
+	}
+
+	m_cold_pending.erase(key);
+
+	chunk *ch = m_arena.get(handle);
+	if (m_last == ch) {
+		m_last = nullptr;
+	}
+
+	for_each_neighbour([&](int dx, int dy, int dz) {
+		chunk *n = ch->get_neighbour(dx, dy, dz);
+		if (n != nullptr) {
+			n->link(-dx, -dy, -dz, nullptr);
+		}
+	});
+
+	if (ch->get_epoch() < m_epoch) {
+		retire(handle);
+	} else {
+		m_arena.free(handle);
+	}
+}
+
+chunk *world_state::get_writable_chunk(const glm::ivec3 &coords)
+{
+	chunk *ch = make_writable(pack_coords(coords));
+	if (ch == nullptr) {
+		return nullptr;
+	}
+
+	for_each_neighbour([&](int dx, int dy, int dz) {
+		chunk *n = ch->get_neighbour(dx, dy, dz);
+		if (n != nullptr && n->get_epoch() < m_epoch) {
+			make_writable(
+				pack_coords(coords + glm::ivec3(dx, dy, dz)));
+		}
+	});
+
+	ch->touch();
+	return ch;
+}
+
+block_id world_state::get_block(const glm::ivec3 &pos) const
+{
+	chunk *ch = find_cached(chunk_coords(pos));
+	if (ch == nullptr) {
+		return blocks::air;
+	}
+
+	glm::ivec3 local = local_coords(pos);
+	return ch->get(local.x, local.y, local.z);
+}
+
+void world_state::set_block(const glm::ivec3 &pos, block_id block)
+{
+	glm::ivec3 coords = chunk_coords(pos);
+
+	chunk *ch = find_cached(coords);
+	if (ch == nullptr) {
+		return;
+	}
+
+	if (ch->get_epoch() < m_epoch) {
+		ch = make_writable(pack_coords(coords));
+	}
+
+	glm::ivec3 local = local_coords(pos);
+
+	// Border blocks are also written into the halos of neighbours
+	glm::ivec3 lo(local.x == CHUNK_BEGIN ? -1 : 0,
+		      local.y == CHUNK_BEGIN ? -1 : 0,
+		      local.z == CHUNK_BEGIN ? -1 : 0);
+	glm::ivec3 hi(local.x == CHUNK_END - 1 ? 1 : 0,
+		      local.y == CHUNK_END - 1 ? 1 : 0,
+		      local.z == CHUNK_END - 1 ? 1 : 0);
+
+	for (int dx = lo.x; dx <= hi.x; dx++) {
+		for (int dy = lo.y; dy <= hi.y; dy++) {
+			for (int dz = lo.z; dz <= hi.z; dz++) {
+				chunk *n = ch->get_neighbour(dx, dy, dz);
+				if (n != nullptr && n->get_epoch() < m_epoch) {
+					make_writable(pack_coords(
+						coords +
+						glm::ivec3(dx, dy, dz)));
+				}
+			}
+		}
+	}
+
+	ch->set(local.x, local.y, local.z, block);
+}
+
+std::shared_ptr<world_snapshot> world_state::snapshot()
+{
+	reclaim();
+
+	std::shared_ptr<world_snapshot> snap(new world_snapshot(this, m_epoch));
+
+	{
+		std::lock_guard lock(m_pin_mutex);
+		m_pins[m_epoch]++;
+	}
+
+	snap->m_chunks.reserve(m_chunks.size());
+	m_chunks.for_each([&](uint64_t key, chunk_arena::handle h) {
+		snap->m_chunks.emplace_back(key, m_arena.get(h));
+	});
+
+	std::sort(snap->m_chunks.begin(), snap->m_chunks.end());
+
+	// Every chunk the snapshot holds is now copied before it is modified
+	m_epoch++;
+
+	return snap;
+}
+
+void world_state::reclaim()
+{
+	uint64_t oldest;
+	{
+		std::lock_guard lock(m_pin_mutex);
+		oldest = m_pins.empty() ? m_epoch : m_pins.begin()->first;
+	}
+
+	// A version retired in epoch e is only seen by snapshots taken before e
+	size_t count = 0;
+	while (count < m_retired.size() && m_retired[count].epoch <= oldest) {
+		m_arena.free(m_retired[count].handle);
+		count++;
+	}
+
+	m_retired.erase(m_retired.begin(), m_retired.begin() + count);
+}
+
+void world_state::update_cold_tier()
+{
+	advance_access_clock();
+
+	std::vector<cold_tier::job> done;
+	m_cold_tier.collect(done);
+
+	for (cold_tier::job &j : done) {
+		auto it = m_cold_pending.find(j.key);
+		if (it == m_cold_pending.end() || it->second != j.id) {
+			continue;
+		}
+
+		m_cold_pending.erase(it);
+
+		// Drop the result if the chunk changed since it was copied
+		chunk *ch = m_arena.get(m_chunks.find(j.key));
+		if (ch->get_generation() == j.generation) {
+			make_writable(j.key)->freeze(std::move(j.compressed));
+		}
+	}
+
+	uint32_t threshold = cold_after.get();
+	if (threshold == 0) {
+		return;
+	}
+
+	uint32_t now = access_clock.load(std::memory_order_relaxed);
+
+	m_chunks.for_each([&](uint64_t key, chunk_arena::handle h) {
+		chunk *ch = m_arena.get(h);
+		if (ch->is_cold() || ch->is_uniform() ||
+		    now - ch->get_last_access() < threshold ||
+		    m_cold_pending.count(key) != 0) {
+			return;
+		}
+
+		uint64_t id = m_cold_next++;
+		m_cold_pending[key] = id;
+
+		m_cold_tier.submit({ id, key, ch->get_generation(),
+				     ch->get_storage(), {} });
+	});
+}
+
+void world_state::link_neighbours(const glm::ivec3 &coords, chunk *ch)
+{
+	for_each_neighbour([&](int dx, int dy, int dz) {
+		// Pulling the halo modifies the neighbour
+		chunk *n = make_writable(
+			pack_coords(coords + glm::ivec3(dx, dy, dz)));
+		if (n == nullptr) {
+			return;
+		}
+
+		ch->link(dx, dy, dz, n);
+		n->link(-dx, -dy, -dz, ch);
+
+		// Exchange halos in both directions in one pass per neighbour
+		ch->pull_halo(dx, dy, dz);
+		n->pull_halo(-dx, -dy, -dz);
+	});
+}
+
+chunk *world_state::make_writable(uint64_t key)
+{
+	chunk_arena::handle handle = m_chunks.find(key);
+	if (handle == 0) {
+		return nullptr;
+	}
+
+	chunk *ch = m_arena.get(handle);
+	if (ch->get_epoch() == m_epoch) {
+		return ch;
+	}
+
+	// Adopt the chunk into this epoch if no live snapshot can see it
+	bool visible;
+	{
+		std::lock_guard lock(m_pin_mutex);
+		visible = !m_pins.empty() &&
+			  m_pins.rbegin()->first >= ch->get_epoch();
+	}
+
+	if (!visible) {
+		ch->set_epoch(m_epoch);
+		return ch;
+	}
+
+	chunk_arena::handle copy_handle = m_arena.alloc(*ch);
+	m_chunks.insert(key, copy_handle);
+
+	chunk *copy = m_arena.get(copy_handle);
+	copy->set_epoch(m_epoch);
+
+	for_each_neighbour([&](int dx, int dy, int dz) {
+		chunk *n = copy->get_neighbour(dx, dy, dz);
+		if (n != nullptr) {
+			n->link(-dx, -dy, -dz, copy);
+		}
+	});
+
+	if (m_last == ch) {
+		m_last = copy;
+	}
+
+	retire(handle);
+	return copy;
+}
+
+void world_state::retire(chunk_arena::handle handle)
+{
+	m_retired.push_back({ handle, m_epoch });
+}
+
+void world_state::unpin(uint64_t epoch)
+{
+	std::lock_guard lock(m_pin_mutex);
+
+	auto it = m_pins.find(epoch);
+	if (--it->second == 0) {
+		m_pins.erase(it);
+	}
+}
+
+glm::ivec3 world_state::unpack_coords(uint64_t key) noexcept
+{
+	// Sign-extend each 21-bit field
+	auto field = [](uint64_t v) {
+		return static_cast<int>(static_cast<int64_t>(v << 43) >> 43);
+	};
+
+	return glm::ivec3(field(key >> 42), field(key >> 21), field(key));
+}
+
+chunk *world_state::find_cached(const glm::ivec3 &coords) const noexcept
+{
+	if (m_last != nullptr && m_last_coords == coords) {
+		return m_last;
+	}
+
+	chunk *ch = get_chunk(coords);
+	if (ch != nullptr) {
+		m_last = ch;
+		m_last_coords = coords;
+	}
+
+	return ch;
+}
+
+world_snapshot::world_snapshot(world_state *world, uint64_t epoch)
+	: m_world(world)
+	, m_epoch(epoch)
+{
+}
+
+world_snapshot::~world_snapshot()
+{
+	m_world->unpin(m_epoch);
+}
+
+const chunk *world_snapshot::get_chunk(const glm::ivec3 &coords) const noexcept
+{
+	uint64_t key = pack_coords(coords);
+
+	auto it = std::lower_bound(
+		m_chunks.begin(), m_chunks.end(), key,
+		[](const auto &entry, uint64_t k) { return entry.first < k; });
+	if (it == m_chunks.end() || it->first != key) {
+		return nullptr;
+	}
+
+	return it->second;
+}
+
+block_id world_snapshot::get_block(const glm::ivec3 &pos) const
+{
+	const chunk *ch = get_chunk(world_state::chunk_coords(pos));
+	if (ch == nullptr) {
+		return blocks::air;
+	}
+
+	glm::ivec3 local = world_state::local_coords(pos);
+	return ch->get(local.x, local.y, local.z);
+}
 }
 }
@@ -0,0 +1,169 @@
+#include "mineclonelib/render/allocator.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <vector>
+
+using namespace mc;
+
+// Used ranges by offset, as the allocator should see them
+using ranges = std::map<uint32_t, uint32_t>;
+
+static uint32_t largest_gap(const ranges &used, uint32_t space)
+{
+	uint32_t largest = 0;
+	uint32_t end = 0;
+	for (const auto &[offset, size] : used) {
+		largest = std::max(largest, offset - end);
+		end = offset + size;
+	}
+
+	return std::max(largest, space - end);
+}
+
+static void check_ranges(const render::range_allocator &alloc,
+			 const ranges &used)
+{
+	uint32_t total = 0;
+	uint32_t end = 0;
+	for (const auto &[offset, size] : used) {
+		REQUIRE(offset >= end);
+		end = offset + size;
+		total += size;
+	}
+
+	REQUIRE(end <= alloc.get_space());
+	REQUIRE(alloc.get_used() == total);
+}
+
+TEST_CASE("range allocator keeps ranges apart under churn", "[allocator]")
+{
+	render::range_allocator alloc;
+	alloc.grow(1 << 16);
+
+	std::mt19937 rng(23);
+
+	ranges used;
+	std::vector<render::range_allocator::handle> handles;
+
+	for (int i = 0; i < 20000; i++) {
+		if (!handles.empty() && rng() % 2 == 0) {
+			size_t at = rng() % handles.size();
+			render::range_allocator::handle h = handles[at];
+
+			REQUIRE(used.erase(alloc.get_offset(h)) == 1);
+			alloc.free(h);
+
+			handles[at] = handles.back();
+			handles.pop_back();
+		} else {
+			// Mostly small ranges, some large enough to fail
+			uint32_t limit = rng() % 8 == 0 ? 8192 : 64;
+			uint32_t size = 1 + rng() % limit;
+
+			render::range_allocator::handle h =
+				alloc.allocate(size);
+			if (h == 0) {
+				// Only when no free range is within a size
+				// class of being large enough
+				REQUIRE(largest_gap(used, alloc.get_space()) <
+					size + size / 8);
+				continue;
+			}
+
+			REQUIRE(alloc.get_size(h) == size);
+			REQUIRE(used.emplace(alloc.get_offset(h), size).second);
+			handles.push_back(h);
+		}
+
+		if (i % 100 == 0) {
+			check_ranges(alloc, used);
+		}
+
+		render::range_allocator::handle last = alloc.get_last();
+		if (used.empty()) {
+			REQUIRE(last == 0);
+		} else {
+			REQUIRE(last != 0);
+			REQUIRE(alloc.get_offset(last) == used.rbegin()->first);
+		}
+	}
+
+	// Freeing everything merges the space back into one range
+	for (render::range_allocator::handle h : handles) {
+		alloc.free(h);
+	}
+
+	REQUIRE(alloc.get_used() == 0);
+
+	render::range_allocator::handle all = alloc.allocate(1 << 16);
+	REQUIRE(all != 0);
+	REQUIRE(alloc.get_offset(all) == 0);
+}
+
+TEST_CASE("freed ranges merge with free neighbours", "[allocator]")
+{
+	// Sizes that start a size class, so a free range of exactly the size
+	// is found
+	render::range_allocator alloc;
+	alloc.grow(384);
+
+	render::range_allocator::handle a = alloc.allocate(128);
+	render::range_allocator::handle b = alloc.allocate(128);
+	render::range_allocator::handle c = alloc.allocate(128);
+	REQUIRE(c != 0);
+	REQUIRE(alloc.allocate(1) == 0);
+
+	REQUIRE(alloc.get_offset(a) + 128 == alloc.get_offset(b));
+	REQUIRE(alloc.get_offset(b) + 128 == alloc.get_offset(c));
+
+	// Two free ranges, apart
+	alloc.free(a);
+	alloc.free(c);
+	REQUIRE(alloc.allocate(256) == 0);
+
+	// One range once the middle is freed too
+	alloc.free(b);
+	render::range_allocator::handle whole = alloc.allocate(384);
+	REQUIRE(whole != 0);
+	REQUIRE(alloc.get_offset(whole) == 0);
+}
+
+TEST_CASE("growing extends a free tail or adds a range", "[allocator]")
+{
+	render::range_allocator alloc;
+	REQUIRE(alloc.allocate(1) == 0);
+	REQUIRE(alloc.get_last() == 0);
+
+	alloc.grow(64);
+	render::range_allocator::handle a = alloc.allocate(40);
+	REQUIRE(alloc.get_offset(a) == 0);
+
+	// The free 24 units at the end grow to 88
+	alloc.grow(64);
+	REQUIRE(alloc.get_space() == 128);
+
+	render::range_allocator::handle b = alloc.allocate(88);
+	REQUIRE(b != 0);
+	REQUIRE(alloc.get_offset(b) == 40);
+	REQUIRE(alloc.get_last() == b);
+
+	// With a used tail, the new space is a range of its own
+	alloc.grow(32);
+	render::range_allocator::handle c = alloc.allocate(32);
+	REQUIRE(c != 0);
+	REQUIRE(alloc.get_offset(c) == 128);
+	REQUIRE(alloc.get_last() == c);
+
+	// Freed, it merges with the range before it
+	alloc.free(c);
+	alloc.free(b);
+	REQUIRE(alloc.get_last() == a);
+
+	render::range_allocator::handle d = alloc.allocate(120);
+	REQUIRE(d != 0);
+	REQUIRE(alloc.get_offset(d) == 40);
+}
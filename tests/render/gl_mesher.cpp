@@ -0,0 +1,181 @@
+#include "../world/meshes.h"
+#include "headless.h"
+
+#include "mineclonelib/io/assets.h"
+#include "mineclonelib/render/gl/utils.h"
+#include "mineclonelib/render/gl/world.h"
+#include "mineclonelib/world/blocks.h"
+
+#include <glad/gl.h>
+
+#include <catch2/catch_template_test_macros.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+using namespace mc;
+
+// chunk_mesh.comp built for chunks of size_log, with the block and AO tables
+// of gl_world_renderer
+template <uint32_t size_log> class gpu_mesher {
+    public:
+	using dims = world::chunk_dims<size_log>;
+
+	static constexpr uint32_t normal_size = dims::max_faces / 6;
+
+	gpu_mesher()
+	{
+		const std::string defines = "#define CHUNK_SIZE_LOG " +
+					    std::to_string(size_log) + "\n";
+
+		GLuint shader = render::gl::load_shader(
+			ASSET_PATH("mineclone/shaders/gl/chunk_mesh.comp"),
+			GL_COMPUTE_SHADER, defines.c_str());
+		if (shader == 0) {
+			return;
+		}
+
+		m_program = glCreateProgram();
+		glAttachShader(m_program, shader);
+		glLinkProgram(m_program);
+		glDetachShader(m_program, shader);
+		glDeleteShader(shader);
+
+		if (!render::gl::check_link_status(m_program)) {
+			glDeleteProgram(m_program);
+			m_program = 0;
+			return;
+		}
+
+		size_t voxels = dims::total * dims::total * dims::total;
+
+		render::gl::create_mesh_tables(m_buffers[block_table],
+					       m_buffers[ao_table]);
+
+		glCreateBuffers(1, &m_buffers[faces]);
+		glNamedBufferStorage(m_buffers[faces],
+				     dims::max_faces *
+					     sizeof(world::packed_face),
+				     nullptr, 0);
+
+		glCreateBuffers(1, &m_buffers[voxel_ids]);
+		glNamedBufferStorage(m_buffers[voxel_ids],
+				     (voxels + 1) / 2 * sizeof(uint32_t),
+				     nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+		glCreateBuffers(1, &m_buffers[counts]);
+		glNamedBufferStorage(m_buffers[counts], 6 * sizeof(GLuint),
+				     nullptr, GL_DYNAMIC_STORAGE_BIT);
+	}
+
+	~gpu_mesher()
+	{
+		glDeleteBuffers(5, m_buffers);
+		glDeleteProgram(m_program);
+	}
+
+	gpu_mesher(const gpu_mesher &) = delete;
+	gpu_mesher &operator=(const gpu_mesher &) = delete;
+
+	inline bool is_ready() const noexcept
+	{
+		return m_program != 0;
+	}
+
+	world::chunk_mesh generate(const world::basic_chunk<size_log> *ch)
+	{
+		size_t count = dims::total * dims::total * dims::total;
+		std::vector<world::block_id> dense(count);
+		ch->unpack(dense.data());
+
+		glNamedBufferSubData(m_buffers[voxel_ids], 0,
+				     count * sizeof(world::block_id),
+				     dense.data());
+
+		GLuint zero = 0;
+		glClearNamedBufferData(m_buffers[counts], GL_R32UI,
+				       GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_buffers[faces]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3,
+				 m_buffers[voxel_ids]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4,
+				 m_buffers[block_table]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5,
+				 m_buffers[ao_table]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6,
+				 m_buffers[counts]);
+
+		GLuint offsets[6];
+		for (uint32_t n = 0; n < 6; n++) {
+			offsets[n] = n * normal_size;
+		}
+
+		glUseProgram(m_program);
+		glUniform1ui(glGetUniformLocation(m_program, "u_slot"), 0);
+		glUniform1uiv(glGetUniformLocation(m_program, "u_offsets"), 6,
+			      offsets);
+		glDispatchCompute(dims::size / 4, dims::size / 4,
+				  dims::size / 4);
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+		// Index counts, six per face
+		GLuint indices[6];
+		glGetNamedBufferSubData(m_buffers[counts], 0, sizeof(indices),
+					indices);
+
+		world::chunk_mesh mesh;
+		for (uint32_t n = 0; n < 6; n++) {
+			mesh.counts[n] = indices[n] / 6;
+
+			size_t at = mesh.faces.size();
+			mesh.faces.resize(at + mesh.counts[n]);
+			glGetNamedBufferSubData(
+				m_buffers[faces],
+				offsets[n] * sizeof(world::packed_face),
+				mesh.counts[n] * sizeof(world::packed_face),
+				mesh.faces.data() + at);
+		}
+
+		return mesh;
+	}
+
+    private:
+	enum buffer { faces, voxel_ids, block_table, ao_table, counts };
+
+	GLuint m_program = 0;
+	GLuint m_buffers[5] = {};
+};
+
+TEMPLATE_TEST_CASE("the compute shader mesher matches the CPU mesher",
+		   "[meshing][gl]", (std::integral_constant<uint32_t, 4>),
+		   (std::integral_constant<uint32_t, 5>),
+		   (std::integral_constant<uint32_t, 6>))
+{
+	constexpr uint32_t size_log = TestType::value;
+
+	if (!test::headless_context::get().is_ready()) {
+		SKIP("No headless OpenGL 4.6 context");
+	}
+
+	gpu_mesher<size_log> gpu;
+	REQUIRE(gpu.is_ready());
+
+	auto pattern = GENERATE(test::chunk_pattern::random,
+				test::chunk_pattern::terrain,
+				test::chunk_pattern::checkerboard,
+				test::chunk_pattern::halo_edges);
+	uint32_t seed = GENERATE(1u, 2u);
+
+	auto ch = std::make_unique<world::basic_chunk<size_log> >();
+	test::fill_chunk<size_log>(*ch, pattern, seed);
+
+	// The shader appends faces in no particular order, so the meshes are
+	// compared as sorted unit faces
+	REQUIRE(test::expand<size_log>(gpu.generate(ch.get())) ==
+		test::reference_faces<size_log>(ch.get()));
+}
@@ -0,0 +1,385 @@
+#include "../world/meshes.h"
+#include "headless.h"
+
+#include "mineclonelib/render/gl/world.h"
+#include "mineclonelib/cvar.h"
+
+#include <glad/gl.h>
+
+#include <glm/glm.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace mc;
+
+using dims = world::chunk_dims<CHUNK_SIZE_LOG>;
+
+// Pixels along the side of a block
+#define BLOCK_PIXELS 2
+
+// Chunks on a grid of columns by rows, seen from straight above through an
+// orthographic projection that gives every block the same square of pixels.
+// Drawing counts the faces that cover each pixel in the stencil buffer, so
+// a face drawn twice or only in part shows up as a wrong count.
+class overhead_view {
+    public:
+	overhead_view(int columns, int rows)
+		: m_columns(columns)
+		, m_rows(rows)
+		, m_width(columns * CHUNK_SIZE * BLOCK_PIXELS)
+		, m_height(rows * CHUNK_SIZE * BLOCK_PIXELS)
+	{
+		glCreateRenderbuffers(2, m_renderbuffers);
+		glNamedRenderbufferStorage(m_renderbuffers[0], GL_RGBA8,
+					   m_width, m_height);
+		glNamedRenderbufferStorage(m_renderbuffers[1],
+					   GL_DEPTH24_STENCIL8, m_width,
+					   m_height);
+
+		glCreateFramebuffers(1, &m_framebuffer);
+		glNamedFramebufferRenderbuffer(m_framebuffer,
+					       GL_COLOR_ATTACHMENT0,
+					       GL_RENDERBUFFER,
+					       m_renderbuffers[0]);
+		glNamedFramebufferRenderbuffer(m_framebuffer,
+					       GL_DEPTH_STENCIL_ATTACHMENT,
+					       GL_RENDERBUFFER,
+					       m_renderbuffers[1]);
+	}
+
+	~overhead_view()
+	{
+		glDeleteFramebuffers(1, &m_framebuffer);
+		glDeleteRenderbuffers(2, m_renderbuffers);
+	}
+
+	overhead_view(const overhead_view &) = delete;
+	overhead_view &operator=(const overhead_view &) = delete;
+
+	// Model matrix of the chunk in the given cell of the grid
+	static glm::mat4 model(int column, int row)
+	{
+		glm::mat4 m(1.0f);
+		m[3][0] = static_cast<float>(column * CHUNK_SIZE);
+		m[3][2] = static_cast<float>(row * CHUNK_SIZE);
+		return m;
+	}
+
+	// Faces drawn over each pixel, bottom row first
+	std::vector<uint8_t> draw(render::world_renderer &renderer) const
+	{
+		// Looking down the y axis with x to the right and z towards
+		// the bottom of the screen, as a camera above the world would
+		glm::mat4 projection(0.0f);
+		projection[0][0] = 2.0f / (m_columns * CHUNK_SIZE);
+		projection[2][1] = -2.0f / (m_rows * CHUNK_SIZE);
+		projection[1][2] = -1.0f / (4 * CHUNK_SIZE);
+		projection[3][0] = -1.0f;
+		projection[3][1] = 1.0f;
+		projection[3][3] = 1.0f;
+
+		glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+		glViewport(0, 0, m_width, m_height);
+
+		// Culling as the GL context sets it up
+		glDisable(GL_DEPTH_TEST);
+		glEnable(GL_CULL_FACE);
+		glCullFace(GL_BACK);
+		glFrontFace(GL_CW);
+		glEnable(GL_STENCIL_TEST);
+		glStencilFunc(GL_ALWAYS, 0, 0xff);
+		glStencilOp(GL_KEEP, GL_KEEP, GL_INCR);
+
+		glClearStencil(0);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT |
+			GL_STENCIL_BUFFER_BIT);
+
+		renderer.render(glm::mat4(1.0f), projection);
+
+		std::vector<uint8_t> counts(m_width * m_height);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadPixels(0, 0, m_width, m_height, GL_STENCIL_INDEX,
+			     GL_UNSIGNED_BYTE, counts.data());
+
+		glDisable(GL_STENCIL_TEST);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		return counts;
+	}
+
+	// The counts draw() gives for the chunks by cell, row after row, with
+	// nullptr for empty cells: the up faces of each column of blocks,
+	// since the others face away or are seen edge-on
+	std::vector<uint8_t>
+	expect(const std::vector<const world::chunk *> &cells) const
+	{
+		std::vector<uint8_t> counts(m_width * m_height);
+		for (size_t cell = 0; cell < cells.size(); cell++) {
+			if (cells[cell] == nullptr) {
+				continue;
+			}
+
+			int x0 = cell % m_columns * CHUNK_SIZE;
+			int z0 = cell / m_columns * CHUNK_SIZE;
+
+			const world::chunk *ch = cells[cell];
+			for (const test::unit_face &face :
+			     test::reference_faces<CHUNK_SIZE_LOG>(ch)) {
+				if (std::get<0>(face) !=
+				    static_cast<int>(world::block_face::up)) {
+					continue;
+				}
+
+				int x = x0 + std::get<1>(face) - dims::begin;
+				int z = z0 + std::get<3>(face) - dims::begin;
+				add_block(counts, x, z);
+			}
+		}
+
+		return counts;
+	}
+
+    private:
+	void add_block(std::vector<uint8_t> &counts, int x, int z) const
+	{
+		for (int i = 0; i < BLOCK_PIXELS; i++) {
+			int row = m_height - 1 - (z * BLOCK_PIXELS + i);
+			for (int j = 0; j < BLOCK_PIXELS; j++) {
+				counts[row * m_width + x * BLOCK_PIXELS + j]++;
+			}
+		}
+	}
+
+    private:
+	int m_columns;
+	int m_rows;
+	int m_width;
+	int m_height;
+
+	GLuint m_framebuffer = 0;
+	GLuint m_renderbuffers[2] = {};
+};
+
+// Pixels where two stencil images differ
+static size_t count_differences(const std::vector<uint8_t> &a,
+				const std::vector<uint8_t> &b)
+{
+	size_t differences = 0;
+	for (size_t i = 0; i < a.size(); i++) {
+		differences += a[i] != b[i];
+	}
+
+	return differences;
+}
+
+static std::unique_ptr<world::chunk> make_chunk(test::chunk_pattern pattern,
+						uint32_t seed)
+{
+	auto ch = std::make_unique<world::chunk>();
+	test::fill_chunk<CHUNK_SIZE_LOG>(*ch, pattern, seed);
+	return ch;
+}
+
+TEST_CASE("indexed quads cover each face exactly once", "[render][gl]")
+{
+	if (!test::headless_context::get().is_ready()) {
+		SKIP("No headless OpenGL 4.6 context");
+	}
+
+	const test::chunk_pattern patterns[] = {
+		test::chunk_pattern::terrain, test::chunk_pattern::random,
+		test::chunk_pattern::checkerboard
+	};
+
+	std::vector<std::unique_ptr<world::chunk> > chunks;
+	for (test::chunk_pattern pattern : patterns) {
+		chunks.push_back(make_chunk(pattern, 22));
+	}
+
+	// Unit faces in the compact format on the first row, merged quads in
+	// the wide one on the second
+	world::simple_chunk_draw_data_generator simple;
+	world::greedy_chunk_draw_data_generator greedy;
+	const world::chunk_draw_data_generator *generators[] = { &simple,
+								 &greedy };
+
+	render::gl_world_renderer renderer(nullptr);
+	overhead_view view(3, 2);
+
+	std::vector<const world::chunk *> cells;
+	for (int row = 0; row < 2; row++) {
+		for (int column = 0; column < 3; column++) {
+			const world::chunk *ch = chunks[column].get();
+			world::chunk_mesh mesh =
+				test::build_mesh(*generators[row], ch);
+
+			glm::mat4 model = overhead_view::model(column, row);
+			renderer.upload_chunk(renderer.alloc_chunk(),
+					      row * 3 + column, &mesh, model);
+			cells.push_back(ch);
+		}
+	}
+
+	REQUIRE(count_differences(view.draw(renderer), view.expect(cells)) ==
+		0);
+}
+
+TEST_CASE("chunks keep drawing as pages and slots are added", "[render][gl]")
+{
+	if (!test::headless_context::get().is_ready()) {
+		SKIP("No headless OpenGL 4.6 context");
+	}
+
+	// The smallest pages, which still hold the ranges of one chunk of any
+	// content, so a few checkerboards take several pages
+	cvar<uint32_t> *page = cvars<uint32_t>::get()->find("render/mesh_page");
+	REQUIRE(page != nullptr);
+
+	uint32_t page_size = page->get();
+	page->set(1);
+	render::gl_world_renderer renderer(nullptr);
+	page->set(page_size);
+
+	const int columns = 4, rows = 4;
+	overhead_view view(columns, rows);
+
+	std::vector<std::unique_ptr<world::chunk> > chunks;
+	for (int cell = 0; cell < columns * rows; cell++) {
+		test::chunk_pattern pattern =
+			cell % 4 == 0 ? test::chunk_pattern::checkerboard :
+					test::chunk_pattern::terrain;
+		chunks.push_back(make_chunk(pattern, cell));
+	}
+
+	world::simple_chunk_draw_data_generator simple;
+	world::greedy_chunk_draw_data_generator greedy;
+
+	std::vector<render::chunk_handle> handles(columns * rows);
+	std::vector<const world::chunk *> cells(columns * rows);
+	uint64_t hash = 0;
+
+	auto upload = [&](int cell, const world::chunk *ch) {
+		const world::chunk_draw_data_generator *gen = &simple;
+		if (cell % 3 == 0) {
+			gen = &greedy;
+		}
+
+		world::chunk_mesh mesh = test::build_mesh(*gen, ch);
+		glm::mat4 model = overhead_view::model(cell % columns,
+						       cell / columns);
+
+		handles[cell] = renderer.alloc_chunk();
+		renderer.upload_chunk(handles[cell], ++hash, &mesh, model);
+		cells[cell] = ch;
+	};
+
+	// More chunks than the renderer starts with slots for
+	for (int cell = 0; cell < columns * rows; cell++) {
+		upload(cell, chunks[cell].get());
+	}
+
+	REQUIRE(count_differences(view.draw(renderer), view.expect(cells)) ==
+		0);
+
+	// Holes in the pages, which later frames compact
+	for (int cell = 1; cell < columns * rows; cell += 4) {
+		renderer.free_chunk(handles[cell]);
+		cells[cell] = nullptr;
+	}
+
+	std::vector<uint8_t> expected = view.expect(cells);
+	for (int frame = 0; frame < 3; frame++) {
+		REQUIRE(count_differences(view.draw(renderer), expected) == 0);
+	}
+
+	// Refilled with chunks from elsewhere on the grid
+	for (int cell = 1; cell < columns * rows; cell += 4) {
+		upload(cell, chunks[(cell + 3) % (columns * rows)].get());
+	}
+
+	expected = view.expect(cells);
+	for (int frame = 0; frame < 3; frame++) {
+		REQUIRE(count_differences(view.draw(renderer), expected) == 0);
+	}
+}
+
+TEST_CASE("uploads through a full staging ring draw as written",
+	  "[render][gl]")
+{
+	if (!test::headless_context::get().is_ready()) {
+		SKIP("No headless OpenGL 4.6 context");
+	}
+
+	// The smallest ring, which only holds the blocks of a chunk, so
+	// uploads wrap it and wait on its fences, and the faces of a
+	// checkerboard are too large for it and written directly
+	cvar<uint32_t> *staging =
+		cvars<uint32_t>::get()->find("render/staging_size");
+	REQUIRE(staging != nullptr);
+
+	uint32_t staging_size = staging->get();
+	staging->set(0);
+	render::gl_world_renderer renderer(nullptr);
+	staging->set(staging_size);
+
+	const int columns = 4, rows = 4;
+	overhead_view view(columns, rows);
+
+	world::greedy_chunk_draw_data_generator greedy;
+
+	std::vector<std::unique_ptr<world::chunk> > chunks;
+	std::vector<world::chunk_mesh> meshes;
+	std::vector<render::chunk_handle> handles;
+	std::vector<const world::chunk *> cells;
+	uint64_t hash = 0;
+
+	// All in one frame
+	for (int cell = 0; cell < columns * rows; cell++) {
+		test::chunk_pattern pattern =
+			cell % 8 == 0 ? test::chunk_pattern::checkerboard :
+					test::chunk_pattern::terrain;
+		chunks.push_back(make_chunk(pattern, cell));
+		meshes.push_back(test::build_mesh(greedy, chunks.back().get()));
+		cells.push_back(chunks.back().get());
+
+		glm::mat4 model = overhead_view::model(cell % columns,
+						       cell / columns);
+		handles.push_back(renderer.alloc_chunk());
+		renderer.upload_chunk(handles.back(), ++hash, &meshes.back(),
+				      model);
+	}
+
+	// Patched in place, staged behind the uploads and each other
+	std::mt19937 rng(25);
+	auto patch = [&](int edits) {
+		for (int e = 0; e < edits; e++) {
+			int cell = rng() % (columns * rows);
+			int x = dims::begin + rng() % dims::size;
+			int y = dims::begin + rng() % dims::size;
+			int z = dims::begin + rng() % dims::size;
+
+			chunks[cell]->set(x, y, z,
+					  rng() % 2 ? world::blocks::dirt :
+						      world::blocks::air);
+			uint8_t normals = world::patch_mesh<CHUNK_SIZE_LOG>(
+				chunks[cell].get(), x, y, z, meshes[cell]);
+			renderer.patch_chunk(handles[cell], ++hash,
+					     &meshes[cell], normals);
+		}
+	};
+
+	patch(64);
+	REQUIRE(count_differences(view.draw(renderer), view.expect(cells)) ==
+		0);
+
+	// And between frames, while earlier copies may still be in flight
+	for (int frame = 0; frame < 3; frame++) {
+		patch(16);
+		REQUIRE(count_differences(view.draw(renderer),
+					  view.expect(cells)) == 0);
+	}
+}
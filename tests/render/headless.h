@@ -0,0 +1,79 @@
+#pragma once
+
+#include <glad/gl.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+namespace mc
+{
+namespace test
+{
+// A surfaceless GL 4.6 core context, made current on the thread running the
+// tests. Mesa's llvmpipe provides one without a display or GPU, though older
+// versions need MESA_GL_VERSION_OVERRIDE=4.6.
+class headless_context {
+    public:
+	headless_context()
+	{
+		m_display = eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+						  EGL_DEFAULT_DISPLAY, nullptr);
+		if (m_display == EGL_NO_DISPLAY ||
+		    !eglInitialize(m_display, nullptr, nullptr) ||
+		    !eglBindAPI(EGL_OPENGL_API)) {
+			return;
+		}
+
+		const EGLint attribs[] = { EGL_CONTEXT_MAJOR_VERSION,
+					   4,
+					   EGL_CONTEXT_MINOR_VERSION,
+					   6,
+					   EGL_CONTEXT_OPENGL_PROFILE_MASK,
+					   EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+					   EGL_NONE };
+		m_context = eglCreateContext(m_display, nullptr, EGL_NO_CONTEXT,
+					     attribs);
+		if (m_context == EGL_NO_CONTEXT ||
+		    !eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+				    m_context)) {
+			return;
+		}
+
+		m_ready = gladLoadGL(reinterpret_cast<GLADloadfunc>(
+				  eglGetProcAddress)) != 0;
+	}
+
+	~headless_context()
+	{
+		if (m_context != EGL_NO_CONTEXT) {
+			eglMakeCurrent(m_display, EGL_NO_SURFACE,
+				       EGL_NO_SURFACE, EGL_NO_CONTEXT);
+			eglDestroyContext(m_display, m_context);
+		}
+
+		if (m_display != EGL_NO_DISPLAY) {
+			eglTerminate(m_display);
+		}
+	}
+
+	headless_context(const headless_context &) = delete;
+	headless_context &operator=(const headless_context &) = delete;
+
+	static headless_context &get()
+	{
+		static headless_context context;
+		return context;
+	}
+
+	inline bool is_ready() const noexcept
+	{
+		return m_ready;
+	}
+
+    private:
+	EGLDisplay m_display = EGL_NO_DISPLAY;
+	EGLContext m_context = EGL_NO_CONTEXT;
+	bool m_ready = false;
+};
+}
+}
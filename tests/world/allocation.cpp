@@ -0,0 +1,243 @@
+#include "meshes.h"
+
+#include "mineclonelib/world/meshing.h"
+#include "mineclonelib/world/world.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <taskflow/core/executor.hpp>
+
+// Heap allocations made off the thread running the tests. That thread
+// requests and collects meshes, and the executor allocates its tasks there,
+// so what is left is the work done by the workers.
+static std::atomic<uint64_t> s_worker_allocations = 0;
+static thread_local bool t_test_thread = false;
+
+static void *counted_alloc(std::size_t size, std::size_t align)
+{
+	if (!t_test_thread) {
+		s_worker_allocations.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	size = size == 0 ? 1 : size;
+
+	void *p = nullptr;
+	if (align > alignof(std::max_align_t)) {
+		size = (size + align - 1) & ~(align - 1);
+		p = std::aligned_alloc(align, size);
+	} else {
+		p = std::malloc(size);
+	}
+
+	if (p == nullptr) {
+		throw std::bad_alloc();
+	}
+
+	return p;
+}
+
+void *operator new(std::size_t size)
+{
+	return counted_alloc(size, 0);
+}
+
+void *operator new[](std::size_t size)
+{
+	return counted_alloc(size, 0);
+}
+
+void *operator new(std::size_t size, std::align_val_t align)
+{
+	return counted_alloc(size, static_cast<std::size_t>(align));
+}
+
+void *operator new[](std::size_t size, std::align_val_t align)
+{
+	return counted_alloc(size, static_cast<std::size_t>(align));
+}
+
+void operator delete(void *p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept
+{
+	std::free(p);
+}
+
+using namespace mc;
+
+// Requests every chunk of snapshot and waits for all of their meshes
+static std::vector<world::meshing_service::result>
+mesh_all(world::meshing_service &service,
+	 const std::shared_ptr<world::world_snapshot> &snapshot)
+{
+	std::vector<glm::ivec3> coords;
+	snapshot->for_each_chunk(
+		[&](const glm::ivec3 &c, const world::chunk *) {
+			coords.push_back(c);
+		});
+
+	for (const glm::ivec3 &c : coords) {
+		service.request(snapshot, c);
+	}
+
+	std::vector<world::meshing_service::result> results;
+	auto deadline = std::chrono::steady_clock::now() +
+			std::chrono::seconds(60);
+	while (results.size() < coords.size() &&
+	       std::chrono::steady_clock::now() < deadline) {
+		if (service.collect(results, coords.size()) == 0) {
+			std::this_thread::sleep_for(
+				std::chrono::milliseconds(1));
+		}
+	}
+
+	REQUIRE(results.size() == coords.size());
+	return results;
+}
+
+// Rolling terrain of mostly dirt, with logs and glass, over 3x2x3 chunks
+static void load_terrain(world::world_state &state)
+{
+	const world::block_id solids[] = { world::blocks::dirt,
+					   test::blocks::log,
+					   test::blocks::glass };
+	std::mt19937 rng(1);
+
+	const int size = CHUNK_SIZE;
+	for (int cx = 0; cx < 3; cx++) {
+		for (int cy = 0; cy < 2; cy++) {
+			for (int cz = 0; cz < 3; cz++) {
+				state.load_chunk({ cx, cy, cz });
+			}
+		}
+	}
+
+	for (int x = 0; x < 3 * size; x++) {
+		for (int z = 0; z < 3 * size; z++) {
+			int height = size + (x * 7 + z * 3) % 9 - 4;
+			for (int y = 0; y < 2 * size; y++) {
+				world::block_id b = world::blocks::air;
+				if (y < height) {
+					bool rare = rng() % 16 == 0;
+					b = solids[rare ? 1 + rng() % 2 : 0];
+				}
+
+				state.set_block({ x, y, z }, b);
+			}
+		}
+	}
+}
+
+TEST_CASE("meshing a warm chunk set does not allocate", "[meshing]")
+{
+	t_test_thread = true;
+
+	world::world_state state;
+	load_terrain(state);
+
+	// A single worker, so the round that warms its scratch arena is the
+	// round before the measured one
+	tf::Executor executor(1);
+	world::meshing_service service(
+		&executor,
+		std::make_unique<world::greedy_chunk_draw_data_generator>());
+
+	// The first round keeps its meshes so the second finds them cached
+	auto first = mesh_all(service, state.snapshot());
+
+	uint64_t before = s_worker_allocations.load();
+	auto second = mesh_all(service, state.snapshot());
+	uint64_t after = s_worker_allocations.load();
+
+	REQUIRE(after - before == 0);
+
+	// Every mesh of the second round is one of the first
+	for (const auto &res : second) {
+		bool cached = std::any_of(first.begin(), first.end(),
+					  [&](const auto &f) {
+						  return f.mesh == res.mesh;
+					  });
+		REQUIRE(cached);
+	}
+}
+
+TEST_CASE("meshing a new chunk allocates only its mesh", "[meshing]")
+{
+	t_test_thread = true;
+
+	world::world_state state;
+	load_terrain(state);
+
+	tf::Executor executor(1);
+	world::meshing_service service(
+		&executor,
+		std::make_unique<world::greedy_chunk_draw_data_generator>());
+
+	auto first = mesh_all(service, state.snapshot());
+
+	// One block changes in every chunk, so none of them is cached
+	for (const auto &res : first) {
+		glm::ivec3 pos = res.coords * CHUNK_SIZE + glm::ivec3(5, 5, 5);
+		bool empty = state.get_block(pos) == world::blocks::air;
+		state.set_block(pos, empty ? test::blocks::glass :
+					     world::blocks::air);
+	}
+
+	uint64_t before = s_worker_allocations.load();
+	auto second = mesh_all(service, state.snapshot());
+	uint64_t after = s_worker_allocations.load();
+
+	// The mesh, its faces, its content and its cache entry
+	REQUIRE(after - before <= 4 * second.size());
+
+	for (const auto &res : second) {
+		bool cached = std::any_of(first.begin(), first.end(),
+					  [&](const auto &f) {
+						  return f.mesh == res.mesh;
+					  });
+		REQUIRE_FALSE(cached);
+	}
+}
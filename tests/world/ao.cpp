@@ -0,0 +1,170 @@
+#include "meshes.h"
+
+#include "mineclonelib/world/ao.h"
+
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace mc;
+
+using ao_kernel = void (*)(const uint64_t *, uint8_t *, uint8_t *);
+
+// The nine AO sample rows of a row of faces, as the greedy mesher gathers
+// them: the rows around and in front of it, shifted by one block either way
+struct ao_words {
+	uint64_t words[9];
+};
+
+static constexpr int c_sample_row[] = { -1, -1, -1, 0, 1, 1, 1, 0, 0 };
+static constexpr int c_sample_shift[] = { -1, 0, 1, 1, 1, 0, -1, -1, 0 };
+
+static uint64_t shift_row(uint64_t row, int shift)
+{
+	return shift < 0 ? row << -shift : shift > 0 ? row >> shift : row;
+}
+
+// The sample words of every x row of ch facing +y
+static std::vector<ao_words> chunk_words(test::chunk_pattern pattern)
+{
+	using dims = world::chunk_dims<CHUNK_SIZE_LOG>;
+
+	auto ch = std::make_unique<world::chunk>();
+	test::fill_chunk<CHUNK_SIZE_LOG>(*ch, pattern, 1);
+
+	const world::chunk::occupancy_type *occ = ch->get_occupancy();
+	REQUIRE(occ != nullptr);
+
+	std::vector<ao_words> out;
+	for (int y = dims::begin; y < dims::end; y++) {
+		for (int z = dims::begin; z < dims::end; z++) {
+			ao_words w;
+			for (int b = 0; b < 9; b++) {
+				uint64_t row = occ->column_x(
+					y + 1, z + c_sample_row[b]);
+				w.words[b] = shift_row(row, c_sample_shift[b]);
+			}
+
+			out.push_back(w);
+		}
+	}
+
+	return out;
+}
+
+static void check_kernel(ao_kernel kernel)
+{
+	std::mt19937_64 rng(7);
+
+	std::vector<ao_words> inputs;
+	for (int i = 0; i < 256; i++) {
+		ao_words w;
+		for (uint64_t &word : w.words) {
+			word = rng();
+		}
+		inputs.push_back(w);
+	}
+
+	// Words that set or clear only the first or last bit of a lane
+	const uint64_t edges[] = { 0,
+				   ~0ull,
+				   1,
+				   1ull << 63,
+				   0x8000000000000001ull,
+				   0x0001000100010001ull,
+				   0x8000800080008000ull,
+				   0x00000000ffffffffull };
+	for (uint64_t e : edges) {
+		for (int b = 0; b < 9; b++) {
+			ao_words w = {};
+			w.words[b] = e;
+			inputs.push_back(w);
+		}
+	}
+
+	for (auto pattern :
+	     { test::chunk_pattern::random, test::chunk_pattern::halo_edges }) {
+		std::vector<ao_words> words = chunk_words(pattern);
+		inputs.insert(inputs.end(), words.begin(), words.end());
+	}
+
+	for (const ao_words &w : inputs) {
+		uint8_t lo[64], hi[64], ref_lo[64], ref_hi[64];
+		std::memset(lo, 0xcc, sizeof(lo));
+		std::memset(hi, 0xcc, sizeof(hi));
+
+		world::gather_ao_indices_scalar(w.words, ref_lo, ref_hi);
+		kernel(w.words, lo, hi);
+
+		REQUIRE(std::memcmp(lo, ref_lo, sizeof(lo)) == 0);
+		REQUIRE(std::memcmp(hi, ref_hi, sizeof(hi)) == 0);
+	}
+}
+
+#ifdef MINECLONE_X86_64
+TEST_CASE("SSE4 AO gather matches the scalar kernel", "[meshing][ao]")
+{
+	if (!world::cpu_supports_sse4()) {
+		SKIP("SSE4.1 is not supported by this CPU");
+	}
+
+	check_kernel(world::gather_ao_indices_sse4);
+}
+
+TEST_CASE("AVX2 AO gather matches the scalar kernel", "[meshing][ao]")
+{
+	if (!world::cpu_supports_avx2()) {
+		SKIP("AVX2 is not supported by this CPU");
+	}
+
+	check_kernel(world::gather_ao_indices_avx2);
+}
+#endif
+
+// Run with the [benchmark] tag, e.g. mineclone_tests "[benchmark]"
+TEST_CASE("AO gather kernels", "[.][benchmark]")
+{
+	auto pattern = GENERATE(test::chunk_pattern::random,
+				test::chunk_pattern::halo_edges);
+	const char *name = pattern == test::chunk_pattern::random ? "dense" :
+								    "sparse";
+
+	std::vector<ao_words> words = chunk_words(pattern);
+
+	auto run = [&](ao_kernel kernel) {
+		uint32_t sum = 0;
+		for (const ao_words &w : words) {
+			uint8_t lo[64], hi[64];
+			kernel(w.words, lo, hi);
+			sum += lo[w.words[0] & 63] + hi[w.words[4] & 63];
+		}
+		return sum;
+	};
+
+	BENCHMARK(std::string("scalar, ") + name)
+	{
+		return run(world::gather_ao_indices_scalar);
+	};
+
+#ifdef MINECLONE_X86_64
+	if (world::cpu_supports_sse4()) {
+		BENCHMARK(std::string("SSE4, ") + name)
+		{
+			return run(world::gather_ao_indices_sse4);
+		};
+	}
+
+	if (world::cpu_supports_avx2()) {
+		BENCHMARK(std::string("AVX2, ") + name)
+		{
+			return run(world::gather_ao_indices_avx2);
+		};
+	}
+#endif
+}
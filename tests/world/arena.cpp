@@ -0,0 +1,95 @@
+#include "mineclonelib/world/arena.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+
+#include <cstdint>
+#include <set>
+#include <vector>
+
+using namespace mc;
+
+// Large enough that a slab holds few of them, and counting its lifetimes
+struct tracked {
+	static inline int live = 0;
+
+	tracked(uint32_t v)
+		: value(v)
+	{
+		live++;
+	}
+
+	~tracked()
+	{
+		live--;
+	}
+
+	uint32_t value;
+	uint8_t payload[60000];
+};
+
+TEST_CASE("slab arena handles stay valid across growth", "[arena]")
+{
+	bool huge_pages = GENERATE(false, true);
+
+	{
+		world::slab_arena<tracked> arena(huge_pages);
+
+		// Spans several slabs
+		std::vector<world::slab_arena<tracked>::handle> handles;
+		std::vector<tracked *> pointers;
+		for (uint32_t i = 0; i < 200; i++) {
+			auto h = arena.alloc(i);
+			REQUIRE(h != 0);
+
+			handles.push_back(h);
+			pointers.push_back(arena.get(h));
+		}
+
+		REQUIRE(arena.size() == 200);
+		REQUIRE(arena.capacity() >= 200);
+		REQUIRE(tracked::live == 200);
+
+		std::set<world::slab_arena<tracked>::handle> unique(
+			handles.begin(), handles.end());
+		REQUIRE(unique.size() == handles.size());
+
+		for (uint32_t i = 0; i < 200; i++) {
+			REQUIRE(arena.get(handles[i]) == pointers[i]);
+			REQUIRE(pointers[i]->value == i);
+
+			// Objects never straddle a slab
+			auto addr = reinterpret_cast<uintptr_t>(pointers[i]);
+			uintptr_t last = addr + sizeof(tracked) - 1;
+			REQUIRE(addr / SLAB_SIZE == last / SLAB_SIZE);
+		}
+
+		// Freed handles are reused before the arena grows again
+		uint32_t capacity = arena.capacity();
+		for (uint32_t i = 0; i < 200; i += 2) {
+			arena.free(handles[i]);
+		}
+
+		REQUIRE(arena.size() == 100);
+		REQUIRE(tracked::live == 100);
+
+		std::set<world::slab_arena<tracked>::handle> freed;
+		for (uint32_t i = 0; i < 200; i += 2) {
+			freed.insert(handles[i]);
+		}
+
+		for (uint32_t i = 0; i < 100; i++) {
+			auto h = arena.alloc(1000 + i);
+			REQUIRE(freed.count(h) == 1);
+		}
+
+		REQUIRE(arena.capacity() == capacity);
+
+		for (uint32_t i = 1; i < 200; i += 2) {
+			REQUIRE(arena.get(handles[i])->value == i);
+		}
+	}
+
+	// The arena destroys what is still allocated
+	REQUIRE(tracked::live == 0);
+}
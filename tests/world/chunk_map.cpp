@@ -0,0 +1,107 @@
+#include "mineclonelib/world/world.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+using namespace mc;
+
+// Checks every key of universe, and the map's contents, against expected
+static void check_map(const world::chunk_map &map,
+		      const std::unordered_map<uint64_t, uint32_t> &expected,
+		      const std::vector<uint64_t> &universe)
+{
+	REQUIRE(map.size() == expected.size());
+
+	for (uint64_t key : universe) {
+		auto it = expected.find(key);
+		uint32_t handle = it == expected.end() ? 0 : it->second;
+		REQUIRE(map.find(key) == handle);
+	}
+
+	size_t visited = 0;
+	map.for_each([&](uint64_t key, world::chunk_arena::handle handle) {
+		auto it = expected.find(key);
+		REQUIRE(it != expected.end());
+		REQUIRE(it->second == handle);
+		visited++;
+	});
+
+	REQUIRE(visited == expected.size());
+}
+
+TEST_CASE("chunk map matches a reference map under churn", "[chunk_map]")
+{
+	// Coordinates around the origin, negative ones included, so keys of
+	// neighbouring chunks are dense
+	std::vector<uint64_t> universe;
+	for (int x = -8; x < 8; x++) {
+		for (int y = -4; y < 4; y++) {
+			for (int z = -8; z < 8; z++) {
+				universe.push_back(
+					world::pack_coords({ x, y, z }));
+			}
+		}
+	}
+
+	world::chunk_map map;
+	std::unordered_map<uint64_t, uint32_t> expected;
+
+	std::mt19937 rng(5);
+	uint32_t next_handle = 1;
+
+	// Grows through several rehashes, then shrinks back by erasing, which
+	// shifts the probe runs back over the holes
+	for (int round = 0; round < 6; round++) {
+		bool growing = round % 2 == 0;
+
+		for (int op = 0; op < 3000; op++) {
+			uint64_t key = universe[rng() % universe.size()];
+
+			if (growing ? rng() % 4 != 0 : rng() % 4 == 0) {
+				uint32_t handle = next_handle++;
+				map.insert(key, handle);
+				expected[key] = handle;
+			} else {
+				auto it = expected.find(key);
+				uint32_t handle =
+					it == expected.end() ? 0 : it->second;
+
+				REQUIRE(map.erase(key) == handle);
+				if (it != expected.end()) {
+					expected.erase(it);
+				}
+			}
+
+			if (op % 500 == 0) {
+				check_map(map, expected, universe);
+			}
+		}
+
+		check_map(map, expected, universe);
+	}
+
+	for (uint64_t key : universe) {
+		map.erase(key);
+	}
+
+	REQUIRE(map.size() == 0);
+	check_map(map, {}, universe);
+}
+
+TEST_CASE("inserting an existing key replaces its handle", "[chunk_map]")
+{
+	world::chunk_map map;
+	uint64_t key = world::pack_coords({ -1, 2, -3 });
+
+	map.insert(key, 4);
+	map.insert(key, 9);
+
+	REQUIRE(map.size() == 1);
+	REQUIRE(map.find(key) == 9);
+	REQUIRE(map.erase(key) == 9);
+	REQUIRE(map.erase(key) == 0);
+	REQUIRE(map.size() == 0);
+}
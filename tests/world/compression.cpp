@@ -0,0 +1,265 @@
+#include "mineclonelib/world/chunk.h"
+#include "mineclonelib/world/compression.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <random>
+#include <vector>
+
+using namespace mc;
+
+using dims = world::chunk_dims<CHUNK_SIZE_LOG>;
+
+static const uint32_t volume = dims::total * dims::total * dims::total;
+
+static uint32_t index(int x, int y, int z)
+{
+	return (x * dims::total + y) * dims::total + z;
+}
+
+static std::vector<uint8_t> lz_round_trip(const std::vector<uint8_t> &data)
+{
+	std::vector<uint8_t> compressed;
+	world::lz_compress(data.data(), data.size(), compressed);
+
+	std::vector<uint8_t> decompressed(data.size());
+	REQUIRE(world::lz_decompress(compressed.data(), compressed.size(),
+				     decompressed.data(), data.size()));
+	REQUIRE(decompressed == data);
+
+	return compressed;
+}
+
+TEST_CASE("lz round-trips random, uniform and repetitive data", "[lz]")
+{
+	std::mt19937 rng(9);
+
+	for (size_t size : { 0, 1, 3, 4, 5, 15, 16, 300, 70000 }) {
+		CAPTURE(size);
+
+		std::vector<uint8_t> random(size);
+		for (uint8_t &byte : random) {
+			byte = rng();
+		}
+
+		// Long runs need the extra length bytes of the token nibbles
+		std::vector<uint8_t> uniform(size, 0x5a);
+
+		std::vector<uint8_t> pattern(size);
+		for (size_t i = 0; i < size; i++) {
+			pattern[i] = (i % 7 == 0 ? rng() : i % 13);
+		}
+
+		lz_round_trip(random);
+		lz_round_trip(pattern);
+
+		std::vector<uint8_t> compressed = lz_round_trip(uniform);
+		if (size >= 300) {
+			REQUIRE(compressed.size() < size / 16);
+		}
+	}
+}
+
+TEST_CASE("lz rejects truncated input", "[lz]")
+{
+	std::mt19937 rng(10);
+
+	std::vector<uint8_t> data(3000);
+	for (size_t i = 0; i < data.size(); i++) {
+		data[i] = (i / 100) % 2 == 0 ? rng() % 4 : 0;
+	}
+
+	// Ending on a match leaves an empty closing sequence behind it
+	data.insert(data.end(), 64, 0);
+
+	std::vector<uint8_t> compressed = lz_round_trip(data);
+
+	std::vector<uint8_t> out(data.size());
+	for (size_t cut = 0; cut < compressed.size(); cut++) {
+		CAPTURE(cut);
+		REQUIRE_FALSE(world::lz_decompress(compressed.data(), cut,
+						   out.data(), out.size()));
+	}
+}
+
+TEST_CASE("lz rejects corrupt input", "[lz]")
+{
+	std::vector<uint8_t> out(16);
+
+	auto decompress = [&](std::vector<uint8_t> stream, size_t size) {
+		return world::lz_decompress(stream.data(), stream.size(),
+					    out.data(), size);
+	};
+
+	// One literal, then 4 bytes copied from the previous byte
+	REQUIRE(decompress({ 0x10, 'a', 0x01, 0x00, 0x00 }, 5));
+	REQUIRE(out[4] == 'a');
+
+	// Offsets before the start of the output, or of zero
+	REQUIRE_FALSE(decompress({ 0x10, 'a', 0x02, 0x00, 0x00 }, 5));
+	REQUIRE_FALSE(decompress({ 0x10, 'a', 0x00, 0x00, 0x00 }, 5));
+
+	// Literals or matches running past the output
+	REQUIRE_FALSE(decompress({ 0x50, 'a', 'b', 'c', 'd', 'e' }, 4));
+	REQUIRE_FALSE(decompress({ 0x10, 'a', 0x01, 0x00, 0x00 }, 4));
+	REQUIRE_FALSE(decompress({ 0x1f, 'a', 0x01, 0x00, 0xff, 0x00, 0x00 },
+				 16));
+
+	// Literals running past the input, with or without extra length
+	REQUIRE_FALSE(decompress({ 0x30, 'a', 'b' }, 3));
+	REQUIRE_FALSE(decompress({ 0xf0, 0xff }, 16));
+
+	// Decoding to a different size than was encoded
+	REQUIRE_FALSE(decompress({ 0x10, 'a', 0x01, 0x00, 0x00 }, 6));
+	REQUIRE_FALSE(decompress({ 0x30, 'a', 'b', 'c' }, 2));
+}
+
+// Stone below a rolling surface, grass on top and air above, with caves
+static std::vector<world::block_id> terrain(std::mt19937 &rng)
+{
+	std::vector<world::block_id> blocks(volume, 0);
+	for (int x = 0; x < dims::total; x++) {
+		for (int z = 0; z < dims::total; z++) {
+			int height = dims::total / 2 + (x * 3 + z * 5) % 7;
+			for (int y = 0; y < height; y++) {
+				blocks[index(x, y, z)] =
+					y + 1 == height ? 2 : 1;
+			}
+		}
+	}
+
+	for (int i = 0; i < 64; i++) {
+		blocks[rng() % volume] = rng() % 3 == 0 ? 3 : 0;
+	}
+
+	return blocks;
+}
+
+static world::palette_storage
+make_storage(const std::vector<world::block_id> &blocks)
+{
+	world::palette_storage storage(volume);
+	for (uint32_t i = 0; i < volume; i++) {
+		storage.set(i, blocks[i]);
+	}
+
+	storage.compact();
+	return storage;
+}
+
+TEST_CASE("palette storage survives encode and decode", "[palette]")
+{
+	std::mt19937 rng(11);
+
+	std::vector<world::block_id> random(volume);
+	for (world::block_id &block : random) {
+		block = rng() % 40;
+	}
+
+	const std::vector<world::block_id> chunks[] = {
+		random, std::vector<world::block_id>(volume, 5), terrain(rng)
+	};
+
+	for (const std::vector<world::block_id> &blocks : chunks) {
+		world::palette_storage storage = make_storage(blocks);
+
+		std::vector<uint8_t> encoded;
+		storage.encode(encoded);
+
+		world::palette_storage decoded(volume);
+		REQUIRE(decoded.decode(encoded.data(), encoded.size()));
+		REQUIRE(decoded.palette() == storage.palette());
+		REQUIRE(decoded.bits() == storage.bits());
+
+		std::vector<world::block_id> dense(volume);
+		decoded.unpack(dense.data());
+		REQUIRE(dense == blocks);
+
+		// A failed decode leaves the storage as it was
+		for (size_t cut = 0; cut < encoded.size();
+		     cut += 1 + cut / 8) {
+			CAPTURE(cut);
+			REQUIRE_FALSE(decoded.decode(encoded.data(), cut));
+		}
+
+		decoded.unpack(dense.data());
+		REQUIRE(dense == blocks);
+	}
+}
+
+TEST_CASE("palette storage rejects out of range runs", "[palette]")
+{
+	world::palette_storage storage(8);
+
+	// A two block palette, then runs of 8 and 1 blocks of entry 1
+	std::vector<uint8_t> runs = { 1, 8, 1, 1 };
+	std::vector<uint8_t> encoded = { 2, 3, 4, 4 };
+	world::lz_compress(runs.data(), runs.size(), encoded);
+	REQUIRE_FALSE(storage.decode(encoded.data(), encoded.size()));
+
+	// Entry 2 is past the end of the palette
+	runs = { 2, 8 };
+	encoded = { 2, 3, 4, 2 };
+	world::lz_compress(runs.data(), runs.size(), encoded);
+	REQUIRE_FALSE(storage.decode(encoded.data(), encoded.size()));
+
+	// Too few blocks
+	runs = { 1, 7 };
+	encoded = { 2, 3, 4, 2 };
+	world::lz_compress(runs.data(), runs.size(), encoded);
+	REQUIRE_FALSE(storage.decode(encoded.data(), encoded.size()));
+
+	runs = { 1, 8 };
+	encoded = { 2, 3, 4, 2 };
+	world::lz_compress(runs.data(), runs.size(), encoded);
+	REQUIRE(storage.decode(encoded.data(), encoded.size()));
+	REQUIRE(storage.get(7) == 4);
+}
+
+TEST_CASE("frozen chunks thaw to the same blocks", "[chunk]")
+{
+	std::mt19937 rng(12);
+	std::vector<world::block_id> blocks = terrain(rng);
+
+	const world::block_id registered[] = {
+		world::blocks::air, world::blocks::dirt, world::blocks::dirt,
+		world::blocks::air
+	};
+
+	world::chunk ch;
+	for (int x = 0; x < dims::total; x++) {
+		for (int y = 0; y < dims::total; y++) {
+			for (int z = 0; z < dims::total; z++) {
+				ch.set(x, y, z,
+				       registered[blocks[index(x, y, z)]]);
+			}
+		}
+	}
+
+	uint32_t generation = ch.get_generation();
+	world::cold_tier_stats before = world::get_cold_tier_stats();
+
+	std::vector<uint8_t> compressed;
+	ch.get_storage().encode(compressed);
+	ch.freeze(std::move(compressed));
+	REQUIRE(ch.is_cold());
+
+	for (int x = 0; x < dims::total; x++) {
+		for (int y = 0; y < dims::total; y++) {
+			for (int z = 0; z < dims::total; z++) {
+				REQUIRE(ch.get(x, y, z) ==
+					registered[blocks[index(x, y, z)]]);
+			}
+		}
+	}
+
+	REQUIRE_FALSE(ch.is_cold());
+	REQUIRE(ch.get_generation() == generation);
+
+	world::cold_tier_stats after = world::get_cold_tier_stats();
+	REQUIRE(after.compressed == before.compressed + 1);
+	REQUIRE(after.decompressed == before.decompressed + 1);
+	REQUIRE(after.decompress_max_ns >= before.decompress_max_ns);
+	REQUIRE(after.decompress_max_ns * after.decompressed >=
+		after.decompress_ns);
+}
@@ -0,0 +1,77 @@
+#include "meshes.h"
+
+#include <catch2/catch_template_test_macros.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include <bit>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+using namespace mc;
+
+// Differs between most neighbouring blocks along every axis, so blocks
+// read back from the wrong place show up
+static world::block_id block_at(int x, int y, int z)
+{
+	const world::block_id blocks[] = { world::blocks::air,
+					   world::blocks::dirt,
+					   test::blocks::log,
+					   test::blocks::glass };
+	return blocks[(x * x + 3 * y + 7 * z * z + x * y + z) % 4];
+}
+
+TEMPLATE_TEST_CASE("chunk dimensions derive from the size log", "[chunk]",
+		   (std::integral_constant<uint32_t, 4>),
+		   (std::integral_constant<uint32_t, 5>),
+		   (std::integral_constant<uint32_t, 6>))
+{
+	constexpr uint32_t size_log = TestType::value;
+	using dims = world::chunk_dims<size_log>;
+
+	STATIC_REQUIRE(dims::size == 1 << size_log);
+	STATIC_REQUIRE(dims::total == dims::size + 2);
+	STATIC_REQUIRE(dims::end - dims::begin == dims::size);
+	STATIC_REQUIRE(std::popcount(dims::column_mask) == dims::size);
+	STATIC_REQUIRE(dims::sections_per_axis * dims::section_size ==
+		       dims::size);
+	STATIC_REQUIRE(dims::max_faces == dims::size * dims::size *
+						  dims::size * 3);
+}
+
+TEMPLATE_TEST_CASE("chunks of every size keep each padded block", "[chunk]",
+		   (std::integral_constant<uint32_t, 4>),
+		   (std::integral_constant<uint32_t, 5>),
+		   (std::integral_constant<uint32_t, 6>))
+{
+	constexpr uint32_t size_log = TestType::value;
+	using dims = world::chunk_dims<size_log>;
+
+	auto ch = std::make_unique<world::basic_chunk<size_log> >();
+	for (int x = 0; x < dims::total; x++) {
+		for (int y = 0; y < dims::total; y++) {
+			for (int z = 0; z < dims::total; z++) {
+				ch->set(x, y, z, block_at(x, y, z));
+			}
+		}
+	}
+
+	// unpack() is x-major, the order the compute mesher reads blocks in
+	std::vector<world::block_id> dense(dims::total * dims::total *
+					   dims::total);
+	ch->unpack(dense.data());
+
+	for (int x = 0; x < dims::total; x++) {
+		for (int y = 0; y < dims::total; y++) {
+			for (int z = 0; z < dims::total; z++) {
+				size_t idx = (static_cast<size_t>(x) *
+						      dims::total +
+					      y) * dims::total +
+					     z;
+
+				REQUIRE(ch->get(x, y, z) == block_at(x, y, z));
+				REQUIRE(dense[idx] == block_at(x, y, z));
+			}
+		}
+	}
+}
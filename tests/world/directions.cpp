@@ -0,0 +1,89 @@
+#include "meshes.h"
+
+#include <catch2/catch_template_test_macros.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+
+#include <memory>
+#include <random>
+#include <type_traits>
+
+using namespace mc;
+
+// Both meshers, each direction of which is specialised, against a mesher
+// that looks at one block and one direction at a time
+template <uint32_t size_log>
+static void check_meshers(const world::basic_chunk<size_log> *ch)
+{
+	world::basic_simple_chunk_draw_data_generator<size_log> simple;
+	world::basic_greedy_chunk_draw_data_generator<size_log> greedy;
+
+	auto expected = test::naive_faces<size_log>(ch);
+
+	REQUIRE(test::expand<size_log>(simple.generate(ch)) == expected);
+	REQUIRE(test::expand<size_log>(greedy.generate(ch)) == expected);
+	REQUIRE(test::expand<size_log>(
+			test::build_mesh<size_log>(simple, ch)) == expected);
+	REQUIRE(test::expand<size_log>(
+			test::build_mesh<size_log>(greedy, ch)) == expected);
+}
+
+TEMPLATE_TEST_CASE("direction meshers match a per-block mesher", "[meshing]",
+		   (std::integral_constant<uint32_t, 4>),
+		   (std::integral_constant<uint32_t, 5>),
+		   (std::integral_constant<uint32_t, 6>))
+{
+	constexpr uint32_t size_log = TestType::value;
+
+	auto pattern = GENERATE(test::chunk_pattern::random,
+				test::chunk_pattern::terrain,
+				test::chunk_pattern::checkerboard,
+				test::chunk_pattern::halo_edges);
+	uint32_t seed = GENERATE(3u, 4u, 5u);
+
+	auto ch = std::make_unique<world::basic_chunk<size_log> >();
+	test::fill_chunk<size_log>(*ch, pattern, seed);
+
+	check_meshers<size_log>(ch.get());
+}
+
+TEMPLATE_TEST_CASE("direction meshers handle uniform interiors", "[meshing]",
+		   (std::integral_constant<uint32_t, 4>),
+		   (std::integral_constant<uint32_t, 5>),
+		   (std::integral_constant<uint32_t, 6>))
+{
+	constexpr uint32_t size_log = TestType::value;
+	using dims = world::chunk_dims<size_log>;
+
+	const world::block_id interiors[] = { world::blocks::dirt,
+					      test::blocks::glass,
+					      world::blocks::air };
+	world::block_id interior = interiors[GENERATE(0, 1, 2)];
+
+	auto ch = std::make_unique<world::basic_chunk<size_log> >();
+	ch->fill(interior);
+	check_meshers<size_log>(ch.get());
+
+	// Only faces on the boundary can show, towards a mixed halo
+	const world::block_id halo[] = { world::blocks::air,
+					 world::blocks::dirt, test::blocks::log,
+					 test::blocks::glass };
+
+	std::mt19937 rng(18);
+	for (int x = 0; x < dims::total; x++) {
+		for (int y = 0; y < dims::total; y++) {
+			for (int z = 0; z < dims::total; z++) {
+				auto outside = [](int c) {
+					return c < dims::begin ||
+					       c >= dims::end;
+				};
+
+				if (outside(x) || outside(y) || outside(z)) {
+					ch->set(x, y, z, halo[rng() % 4]);
+				}
+			}
+		}
+	}
+
+	check_meshers<size_log>(ch.get());
+}
@@ -0,0 +1,139 @@
+#include "mineclonelib/world/chunk.h"
+
+#include <catch2/catch_template_test_macros.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <random>
+#include <type_traits>
+
+using namespace mc;
+
+TEMPLATE_TEST_CASE("chunks start dirty in every section", "[chunk]",
+		   (std::integral_constant<uint32_t, 4>),
+		   (std::integral_constant<uint32_t, 5>),
+		   (std::integral_constant<uint32_t, 6>))
+{
+	constexpr uint32_t size_log = TestType::value;
+
+	world::basic_chunk<size_log> ch;
+	REQUIRE(ch.is_dirty());
+	REQUIRE(ch.dirty_sections().all());
+
+	ch.clear_dirty();
+	REQUIRE_FALSE(ch.is_dirty());
+	REQUIRE(ch.dirty_sections().none());
+
+	// fill() changes every block at once
+	uint32_t generation = ch.get_generation();
+	ch.fill(world::blocks::dirt);
+	REQUIRE(ch.get_generation() > generation);
+	REQUIRE(ch.dirty_sections().all());
+}
+
+TEMPLATE_TEST_CASE("edits mark the section they fall in", "[chunk]",
+		   (std::integral_constant<uint32_t, 4>),
+		   (std::integral_constant<uint32_t, 5>),
+		   (std::integral_constant<uint32_t, 6>))
+{
+	constexpr uint32_t size_log = TestType::value;
+	using dims = world::chunk_dims<size_log>;
+	using chunk = world::basic_chunk<size_log>;
+
+	chunk ch;
+	ch.clear_dirty();
+
+	// Halo blocks count towards the interior section next to them
+	auto section_of = [](int c) {
+		c = std::clamp(c, dims::begin, dims::end - 1);
+		return (c - dims::begin) / dims::section_size;
+	};
+
+	std::mt19937 rng(8);
+	for (int e = 0; e < 200; e++) {
+		int x = rng() % dims::total;
+		int y = rng() % dims::total;
+		int z = rng() % dims::total;
+
+		uint32_t generation = ch.get_generation();
+		ch.set(x, y, z, e % 2 == 0 ? world::blocks::dirt :
+					     world::blocks::air);
+
+		CAPTURE(x, y, z);
+		REQUIRE(ch.get_generation() == generation + 1);
+		REQUIRE(ch.is_dirty());
+
+		const int n = dims::sections_per_axis;
+		uint32_t expected =
+			(section_of(x) * n + section_of(y)) * n + section_of(z);
+		REQUIRE(chunk::section_index(x, y, z) == expected);
+
+		auto changed = ch.changed_since(generation);
+		REQUIRE(changed.count() == 1);
+		REQUIRE(changed.test(expected));
+		REQUIRE(ch.changed_since(ch.get_generation()).none());
+
+		ch.clear_dirty();
+		REQUIRE(ch.dirty_sections().none());
+	}
+}
+
+TEMPLATE_TEST_CASE("changed_since accumulates edits", "[chunk]",
+		   (std::integral_constant<uint32_t, 4>),
+		   (std::integral_constant<uint32_t, 5>),
+		   (std::integral_constant<uint32_t, 6>))
+{
+	constexpr uint32_t size_log = TestType::value;
+	using dims = world::chunk_dims<size_log>;
+	using chunk = world::basic_chunk<size_log>;
+
+	chunk ch;
+	uint32_t start = ch.get_generation();
+
+	typename chunk::section_mask expected;
+	std::mt19937 rng(9);
+	for (int e = 0; e < 20; e++) {
+		int x = dims::begin + rng() % dims::size;
+		int y = dims::begin + rng() % dims::size;
+		int z = dims::begin + rng() % dims::size;
+
+		ch.set(x, y, z, world::blocks::dirt);
+		expected.set(chunk::section_index(x, y, z));
+	}
+
+	REQUIRE(ch.changed_since(start) == expected);
+	REQUIRE(ch.dirty_sections().all());
+}
+
+TEMPLATE_TEST_CASE("dilate grows masks by one section", "[chunk]",
+		   (std::integral_constant<uint32_t, 4>),
+		   (std::integral_constant<uint32_t, 5>),
+		   (std::integral_constant<uint32_t, 6>))
+{
+	constexpr uint32_t size_log = TestType::value;
+	using dims = world::chunk_dims<size_log>;
+	using chunk = world::basic_chunk<size_log>;
+
+	const int n = dims::sections_per_axis;
+
+	for (int i = 0; i < dims::sections; i++) {
+		typename chunk::section_mask mask;
+		mask.set(i);
+
+		auto grown = chunk::dilate(mask);
+
+		int x = i / (n * n), y = (i / n) % n, z = i % n;
+		for (int j = 0; j < dims::sections; j++) {
+			int jx = j / (n * n), jy = (j / n) % n, jz = j % n;
+			bool near = std::abs(jx - x) <= 1 &&
+				    std::abs(jy - y) <= 1 &&
+				    std::abs(jz - z) <= 1;
+
+			CAPTURE(i, j);
+			REQUIRE(grown.test(j) == near);
+		}
+	}
+
+	REQUIRE(chunk::dilate({}).none());
+}
@@ -0,0 +1,35 @@
+#include "meshes.h"
+
+#include <catch2/catch_template_test_macros.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+
+#include <memory>
+#include <type_traits>
+
+using namespace mc;
+
+TEMPLATE_TEST_CASE("greedy quads cover the faces of the simple mesher",
+		   "[meshing]", (std::integral_constant<uint32_t, 4>),
+		   (std::integral_constant<uint32_t, 5>),
+		   (std::integral_constant<uint32_t, 6>))
+{
+	constexpr uint32_t size_log = TestType::value;
+
+	auto pattern = GENERATE(test::chunk_pattern::random,
+				test::chunk_pattern::terrain,
+				test::chunk_pattern::checkerboard,
+				test::chunk_pattern::halo_edges);
+	uint32_t seed = GENERATE(1u, 2u);
+
+	auto ch = std::make_unique<world::basic_chunk<size_log> >();
+	test::fill_chunk<size_log>(*ch, pattern, seed);
+
+	world::basic_greedy_chunk_draw_data_generator<size_log> greedy;
+	auto expected = test::reference_faces<size_log>(ch.get());
+
+	REQUIRE(test::expand<size_log>(greedy.generate(ch.get())) == expected);
+	REQUIRE(test::expand<size_log>(
+			test::build_mesh<size_log>(greedy, ch.get())) ==
+		expected);
+}
@@ -0,0 +1,113 @@
+#include "mineclonelib/world/world.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <random>
+
+using namespace mc;
+
+using dims = world::chunk_dims<CHUNK_SIZE_LOG>;
+
+// Checks that every halo block of the chunk at coords whose owner is loaded
+// matches the block there
+static void check_halo(const world::world_state &state,
+		       const glm::ivec3 &coords)
+{
+	const world::chunk *ch = state.get_chunk(coords);
+	REQUIRE(ch != nullptr);
+
+	auto halo = [](int c) { return c == 0 || c == dims::total - 1; };
+
+	for (int x = 0; x < dims::total; x++) {
+		for (int y = 0; y < dims::total; y++) {
+			for (int z = 0; z < dims::total; z++) {
+				if (!halo(x) && !halo(y) && !halo(z)) {
+					continue;
+				}
+
+				glm::ivec3 pos = coords * CHUNK_SIZE +
+						 glm::ivec3(x, y, z) -
+						 dims::begin;
+				glm::ivec3 owner =
+					world::world_state::chunk_coords(pos);
+				if (state.get_chunk(owner) == nullptr) {
+					continue;
+				}
+
+				CAPTURE(coords.x, coords.y, coords.z, x, y, z);
+				REQUIRE(ch->get(x, y, z) ==
+					state.get_block(pos));
+			}
+		}
+	}
+}
+
+// A world coordinate along one axis of an n chunk wide region, biased
+// towards chunk borders
+static int edit_coord(std::mt19937 &rng, int chunks)
+{
+	int c = rng() % chunks;
+	switch (rng() % 3) {
+	case 0:
+		return c * CHUNK_SIZE;
+	case 1:
+		return c * CHUNK_SIZE + CHUNK_SIZE - 1;
+	default:
+		return c * CHUNK_SIZE + rng() % CHUNK_SIZE;
+	}
+}
+
+TEST_CASE("edits on chunk borders reach the halos of neighbours", "[world]")
+{
+	world::world_state state;
+	for (int x = 0; x < 3; x++) {
+		for (int y = 0; y < 3; y++) {
+			for (int z = 0; z < 3; z++) {
+				state.load_chunk({ x, y, z });
+			}
+		}
+	}
+
+	std::mt19937 rng(6);
+	for (int e = 0; e < 3000; e++) {
+		glm::ivec3 pos(edit_coord(rng, 3), edit_coord(rng, 3),
+			       edit_coord(rng, 3));
+		state.set_block(pos, rng() % 2 == 0 ? world::blocks::dirt :
+						      world::blocks::air);
+	}
+
+	for (int x = 0; x < 3; x++) {
+		for (int y = 0; y < 3; y++) {
+			for (int z = 0; z < 3; z++) {
+				check_halo(state, { x, y, z });
+			}
+		}
+	}
+}
+
+TEST_CASE("loading a chunk exchanges halos with its neighbours", "[world]")
+{
+	world::world_state state;
+	state.load_chunk({ 0, 0, 0 });
+	state.load_chunk({ 1, 1, 0 });
+
+	std::mt19937 rng(7);
+	for (int e = 0; e < 2000; e++) {
+		glm::ivec3 pos(edit_coord(rng, 2), edit_coord(rng, 2),
+			       rng() % CHUNK_SIZE);
+		state.set_block(pos, world::blocks::dirt);
+	}
+
+	// Touches both chunks above on a face, an edge and a corner
+	state.load_chunk({ 1, 0, 0 }, world::blocks::dirt);
+	state.load_chunk({ 0, 1, 1 });
+
+	state.set_block({ CHUNK_SIZE, 0, 0 }, world::blocks::air);
+	state.set_block({ CHUNK_SIZE - 1, CHUNK_SIZE, CHUNK_SIZE - 1 },
+			world::blocks::dirt);
+
+	check_halo(state, { 0, 0, 0 });
+	check_halo(state, { 1, 1, 0 });
+	check_halo(state, { 1, 0, 0 });
+	check_halo(state, { 0, 1, 1 });
+}
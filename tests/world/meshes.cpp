@@ -0,0 +1,287 @@
+#include "meshes.h"
+
+#include <algorithm>
+#include <memory>
+#include <random>
+
+namespace mc
+{
+namespace test
+{
+using namespace world;
+
+class test_face : public face {
+    public:
+	test_face(const char *texture)
+		: m_texture(texture)
+	{
+	}
+
+	virtual const char *get_texture() const override
+	{
+		return m_texture;
+	}
+
+    private:
+	const char *m_texture;
+};
+
+class test_block : public block {
+    public:
+	test_block(face_id first, bool opaque)
+	{
+		for (int k = 0; k < 6; k++) {
+			m_faces[k] = first + k % 3;
+		}
+
+		m_opaque = opaque;
+	}
+};
+
+// Textures are never loaded by the meshers, only checked for
+static block_id register_block(const char *name, bool opaque)
+{
+	face_registry *freg = faces::get_registry();
+
+	face_id first = freg->register_face(std::make_unique<test_face>(name));
+	freg->register_face(std::make_unique<test_face>(name));
+	freg->register_face(std::make_unique<test_face>(name));
+
+	return world::blocks::get_registry()->register_block(
+		std::make_unique<test_block>(first, opaque));
+}
+
+namespace blocks
+{
+block_id log = register_block("log", true);
+block_id glass = register_block("glass", false);
+}
+
+// The axes a merged quad extends along, as chunk.vert defines them
+static constexpr int c_quad_left[] = { 2, 1, 0, 2, 1, 0 };
+static constexpr int c_quad_top[] = { 1, 2, 2, 0, 0, 1 };
+
+template <uint32_t size_log>
+void fill_chunk(basic_chunk<size_log> &ch, chunk_pattern pattern,
+		uint32_t seed)
+{
+	using dims = chunk_dims<size_log>;
+
+	const block_id solids[] = { world::blocks::dirt, blocks::log,
+				    blocks::glass };
+
+	std::mt19937 rng(seed);
+	auto any_solid = [&] { return solids[rng() % 3]; };
+
+	for (int x = 0; x < dims::total; x++) {
+		for (int y = 0; y < dims::total; y++) {
+			for (int z = 0; z < dims::total; z++) {
+				block_id b = world::blocks::air;
+
+				switch (pattern) {
+				case chunk_pattern::random:
+					if (rng() % 3 != 0) {
+						b = any_solid();
+					}
+					break;
+				case chunk_pattern::terrain: {
+					int height = dims::size / 2 +
+						     (x * 7 + z * 3) % 5;
+					if (y < height - 2) {
+						b = world::blocks::dirt;
+					} else if (y < height) {
+						b = blocks::log;
+					} else if (y == height &&
+						   rng() % 8 == 0) {
+						b = blocks::glass;
+					}
+					break;
+				}
+				case chunk_pattern::checkerboard:
+					if ((x + y + z) % 2 == 0) {
+						b = solids[(x + seed) % 3];
+					}
+					break;
+				case chunk_pattern::halo_edges: {
+					auto edge = [](int c) {
+						return c <= dims::begin ||
+						       c >= dims::end - 1;
+					};
+					if ((edge(x) || edge(y) || edge(z)) &&
+					    rng() % 2 == 0) {
+						b = any_solid();
+					}
+					break;
+				}
+				}
+
+				ch.set(x, y, z, b);
+			}
+		}
+	}
+}
+
+template <uint32_t size_log>
+std::vector<unit_face> reference_faces(const basic_chunk<size_log> *ch)
+{
+	basic_simple_chunk_draw_data_generator<size_log> gen;
+	return expand<size_log>(gen.generate(ch));
+}
+
+// Offset to the neighbour in front of a face, and the axes around it that
+// ambient occlusion samples, by block_face
+static constexpr int c_d[6][3] = { { 1, 0, 0 },  { -1, 0, 0 },
+				   { 0, 1, 0 },  { 0, -1, 0 },
+				   { 0, 0, 1 },  { 0, 0, -1 } };
+static constexpr int c_dleft[6][3] = { { 0, -1, 0 }, { 0, 0, -1 },
+				       { 0, 0, -1 }, { -1, 0, 0 },
+				       { -1, 0, 0 }, { 0, -1, 0 } };
+static constexpr int c_dtop[6][3] = { { 0, 0, 1 }, { 0, 1, 0 },
+				      { 1, 0, 0 }, { 0, 0, 1 },
+				      { 0, 1, 0 }, { 1, 0, 0 } };
+
+// Ambient occlusion of face k, given the block n in front of it
+template <uint32_t size_log>
+static uint8_t naive_ao(const basic_chunk<size_log> *ch, int k,
+			const int (&n)[3])
+{
+	const block_properties *props = world::blocks::get_properties();
+
+	uint32_t samples = 0;
+	for (int b = 0; b < 9; b++) {
+		int di = b / 3 - 1, dj = b % 3 - 1;
+
+		int p[3];
+		for (int a = 0; a < 3; a++) {
+			p[a] = n[a] + c_dleft[k][a] * di + c_dtop[k][a] * dj;
+		}
+
+		if (props->is_opaque(ch->get(p[0], p[1], p[2]))) {
+			samples |= 1u << b;
+		}
+	}
+
+	return world::get_face_ao(samples);
+}
+
+template <uint32_t size_log>
+std::vector<unit_face> naive_faces(const basic_chunk<size_log> *ch)
+{
+	using dims = chunk_dims<size_log>;
+
+	const block_properties *props = world::blocks::get_properties();
+
+	std::vector<unit_face> out;
+	for (int k = 0; k < 6; k++) {
+		block_face kf = static_cast<block_face>(k);
+
+		for (int x = dims::begin; x < dims::end; x++) {
+			for (int y = dims::begin; y < dims::end; y++) {
+				for (int z = dims::begin; z < dims::end; z++) {
+					const int n[3] = { x + c_d[k][0],
+							   y + c_d[k][1],
+							   z + c_d[k][2] };
+
+					face_id face = props->get_face(
+						ch->get(x, y, z), kf);
+					face_id front = props->get_face(
+						ch->get(n[0], n[1], n[2]), kf);
+
+					if (props->is_renderable(face) &&
+					    !props->is_renderable(front)) {
+						out.emplace_back(
+							k, x, y, z, face,
+							naive_ao(ch, k, n));
+					}
+				}
+			}
+		}
+	}
+
+	std::sort(out.begin(), out.end());
+	return out;
+}
+
+template <uint32_t size_log>
+static void expand_face(const face_draw_data &f, int k,
+			std::vector<unit_face> &out)
+{
+	for (int a = 0; a < f.w; a++) {
+		for (int b = 0; b < f.h; b++) {
+			int p[3] = { f.x, f.y, f.z };
+			p[c_quad_left[k]] += a;
+			p[c_quad_top[k]] += b;
+
+			out.emplace_back(k, p[0], p[1], p[2], f.face, f.ao);
+		}
+	}
+}
+
+template <uint32_t size_log>
+std::vector<unit_face> expand(const chunk_draw_data &data)
+{
+	std::vector<unit_face> out;
+	for (const face_draw_data &f : data.faces) {
+		expand_face<size_log>(f, static_cast<int>(f.normal), out);
+	}
+
+	std::sort(out.begin(), out.end());
+	return out;
+}
+
+template <uint32_t size_log>
+std::vector<unit_face> expand(const chunk_mesh &mesh)
+{
+	std::vector<unit_face> out;
+
+	uint32_t offset = 0;
+	for (int k = 0; k < 6; k++) {
+		for (uint32_t i = 0; i < mesh.counts[k]; i++) {
+			face_draw_data f =
+				unpack_face<size_log>(mesh.faces[offset + i]);
+			expand_face<size_log>(f, k, out);
+		}
+
+		offset += mesh.counts[k];
+	}
+
+	std::sort(out.begin(), out.end());
+	return out;
+}
+
+template <uint32_t size_log>
+chunk_mesh build_mesh(const basic_chunk_draw_data_generator<size_log> &gen,
+		      const basic_chunk<size_log> *ch)
+{
+	std::vector<packed_face> faces(chunk_dims<size_log>::max_faces);
+	basic_face_sink<size_log> sink(faces.data());
+	gen.generate(ch, sink);
+
+	chunk_mesh mesh;
+	mesh.faces.assign(sink.data(), sink.data() + sink.size());
+	for (int n = 0; n < 6; n++) {
+		mesh.counts[n] = sink.get_count(static_cast<block_face>(n));
+	}
+
+	return mesh;
+}
+
+#define INSTANTIATE(size_log)                                                 \
+	template void fill_chunk<size_log>(basic_chunk<size_log> &,           \
+					   chunk_pattern, uint32_t);          \
+	template std::vector<unit_face> reference_faces<size_log>(            \
+		const basic_chunk<size_log> *);                               \
+	template std::vector<unit_face> naive_faces<size_log>(                \
+		const basic_chunk<size_log> *);                               \
+	template std::vector<unit_face> expand<size_log>(                     \
+		const chunk_draw_data &);                                     \
+	template std::vector<unit_face> expand<size_log>(const chunk_mesh &); \
+	template chunk_mesh build_mesh<size_log>(                             \
+		const basic_chunk_draw_data_generator<size_log> &,            \
+		const basic_chunk<size_log> *);
+
+INSTANTIATE(4)
+INSTANTIATE(5)
+INSTANTIATE(6)
+}
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "mineclonelib/world/chunk.h"
+
+#include <cstdint>
+#include <tuple>
+#include <vector>
+
+namespace mc
+{
+namespace test
+{
+// Blocks registered by the tests on top of the engine's, before the block
+// properties are built
+namespace blocks
+{
+// Opaque, with three different faces
+extern world::block_id log;
+
+// Renderable but not opaque
+extern world::block_id glass;
+}
+
+enum class chunk_pattern {
+	random,
+	terrain,
+	checkerboard,
+
+	// Empty but for random blocks on the interior boundary and in the
+	// halo
+	halo_edges
+};
+
+// A face of one block: normal, x, y, z, face id and AO
+using unit_face = std::tuple<int, int, int, int, world::face_id, uint8_t>;
+
+// Fills every block of ch, halo included, from seed
+template <uint32_t size_log>
+void fill_chunk(world::basic_chunk<size_log> &ch, chunk_pattern pattern,
+		uint32_t seed);
+
+// The faces of the simple mesher, sorted
+template <uint32_t size_log>
+std::vector<unit_face> reference_faces(const world::basic_chunk<size_log> *ch);
+
+// The faces of every block, found one block and one direction at a time
+// with no shortcuts, sorted
+template <uint32_t size_log>
+std::vector<unit_face> naive_faces(const world::basic_chunk<size_log> *ch);
+
+// Faces split into unit faces and sorted, so meshes can be compared however
+// their quads are merged
+template <uint32_t size_log>
+std::vector<unit_face> expand(const world::chunk_draw_data &data);
+
+template <uint32_t size_log>
+std::vector<unit_face> expand(const world::chunk_mesh &mesh);
+
+// Meshes ch into a chunk_mesh, as the meshing service does
+template <uint32_t size_log>
+world::chunk_mesh
+build_mesh(const world::basic_chunk_draw_data_generator<size_log> &gen,
+	   const world::basic_chunk<size_log> *ch);
+}
+}
@@ -0,0 +1,328 @@
+#include "meshes.h"
+
+#include "mineclonelib/world/meshing.h"
+#include "mineclonelib/world/world.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <future>
+#include <random>
+#include <memory>
+#include <vector>
+
+#include <taskflow/core/executor.hpp>
+
+using namespace mc;
+
+// Occupies the only worker of executor until the returned promise is set,
+// so requests made meanwhile stay queued in the service
+static std::shared_ptr<std::promise<void> > hold(tf::Executor &executor)
+{
+	auto release = std::make_shared<std::promise<void> >();
+	std::shared_future<void> released = release->get_future().share();
+
+	std::promise<void> started;
+	std::future<void> running = started.get_future();
+	executor.silent_async([released, &started] {
+		started.set_value();
+		released.wait();
+	});
+
+	running.wait();
+	return release;
+}
+
+// Waits for everything posted to the single worker of executor so far
+static void flush(tf::Executor &executor)
+{
+	std::promise<void> done;
+	std::future<void> finished = done.get_future();
+	executor.silent_async([&done] { done.set_value(); });
+	finished.wait();
+}
+
+struct meshing_fixture {
+	meshing_fixture()
+		: executor(1)
+		, service(&executor,
+			  std::make_unique<
+				  world::greedy_chunk_draw_data_generator>())
+	{
+		for (int x = 0; x < 4; x++) {
+			state.load_chunk({ x, 0, 0 }, world::blocks::air);
+			state.set_block({ x * CHUNK_SIZE + 3, 4, 5 },
+					world::blocks::dirt);
+		}
+	}
+
+	std::vector<world::meshing_service::result> collect()
+	{
+		flush(executor);
+
+		std::vector<world::meshing_service::result> results;
+		service.collect(results, 100);
+		return results;
+	}
+
+	world::world_state state;
+
+	// A single worker, which also runs the service's jobs one at a time
+	tf::Executor executor;
+	world::meshing_service service;
+};
+
+TEST_CASE_METHOD(meshing_fixture, "requests for a queued chunk coalesce",
+		 "[meshing]")
+{
+	auto snapshot = state.snapshot();
+
+	auto release = hold(executor);
+	service.request(snapshot, { 1, 0, 0 });
+	service.request(snapshot, { 1, 0, 0 });
+	service.request(state.snapshot(), { 1, 0, 0 });
+	REQUIRE(service.get_queued() == 1);
+
+	// Chunks that are not loaded are ignored
+	service.request(snapshot, { 9, 0, 0 });
+	REQUIRE(service.get_queued() == 1);
+
+	release->set_value();
+
+	auto results = collect();
+	REQUIRE(results.size() == 1);
+	REQUIRE(results[0].coords == glm::ivec3(1, 0, 0));
+	REQUIRE(results[0].generation ==
+		snapshot->get_chunk({ 1, 0, 0 })->get_generation());
+	REQUIRE(service.get_queued() == 0);
+
+	// Once collected, the same generation is meshed again, from the cache
+	service.request(snapshot, { 1, 0, 0 });
+	auto again = collect();
+	REQUIRE(again.size() == 1);
+	REQUIRE(again[0].mesh == results[0].mesh);
+}
+
+TEST_CASE_METHOD(meshing_fixture, "newer generations supersede older ones",
+		 "[meshing]")
+{
+	auto old_snapshot = state.snapshot();
+	uint32_t old_generation =
+		old_snapshot->get_chunk({ 2, 0, 0 })->get_generation();
+
+	state.set_block({ 2 * CHUNK_SIZE + 7, 7, 7 }, world::blocks::dirt);
+	auto new_snapshot = state.snapshot();
+	uint32_t new_generation =
+		new_snapshot->get_chunk({ 2, 0, 0 })->get_generation();
+	REQUIRE(new_generation != old_generation);
+
+	// Replaced while queued
+	auto release = hold(executor);
+	service.request(old_snapshot, { 2, 0, 0 });
+	service.request(new_snapshot, { 2, 0, 0 });
+	REQUIRE(service.get_queued() == 1);
+	release->set_value();
+
+	auto results = collect();
+	REQUIRE(results.size() == 1);
+	REQUIRE(results[0].generation == new_generation);
+
+	// Replaced after meshing but before collection, which drops the
+	// finished mesh
+	service.request(old_snapshot, { 2, 0, 0 });
+	flush(executor);
+	service.request(new_snapshot, { 2, 0, 0 });
+
+	results = collect();
+	REQUIRE(results.size() == 1);
+	REQUIRE(results[0].generation == new_generation);
+	REQUIRE_FALSE(results[0].mesh->faces.empty());
+}
+
+TEST_CASE_METHOD(meshing_fixture, "cancelled chunks yield no result",
+		 "[meshing]")
+{
+	auto snapshot = state.snapshot();
+
+	// Cancelled while queued
+	auto release = hold(executor);
+	service.request(snapshot, { 0, 0, 0 });
+	service.request(snapshot, { 3, 0, 0 });
+	service.cancel({ 0, 0, 0 });
+	REQUIRE(service.get_queued() == 1);
+	release->set_value();
+
+	auto results = collect();
+	REQUIRE(results.size() == 1);
+	REQUIRE(results[0].coords == glm::ivec3(3, 0, 0));
+
+	// Cancelled once meshed
+	service.request(snapshot, { 0, 0, 0 });
+	flush(executor);
+	service.cancel({ 0, 0, 0 });
+	REQUIRE(collect().empty());
+
+	// Cancelling a chunk the service does not know is harmless
+	service.cancel({ 5, 5, 5 });
+	REQUIRE(service.get_queued() == 0);
+}
+
+TEST_CASE_METHOD(meshing_fixture, "chunks nearest the camera mesh first",
+		 "[meshing]")
+{
+	auto snapshot = state.snapshot();
+
+	// Beyond the last chunk, so the order is the reverse of loading
+	glm::vec3 camera(10.0f * CHUNK_SIZE, 0.0f, 0.0f);
+	service.set_view(
+		glm::inverse(glm::translate(glm::mat4(1.0f), camera)));
+
+	auto release = hold(executor);
+	for (int x = 0; x < 4; x++) {
+		service.request(snapshot, { x, 0, 0 });
+	}
+
+	REQUIRE(service.get_queued() == 4);
+	release->set_value();
+
+	auto results = collect();
+	REQUIRE(results.size() == 4);
+	for (int i = 0; i < 4; i++) {
+		REQUIRE(results[i].coords == glm::ivec3(3 - i, 0, 0));
+	}
+}
+
+TEST_CASE("chunk content encodings match exactly when the blocks do",
+	  "[meshing]")
+{
+	const world::block_id solids[] = { world::blocks::dirt,
+					   test::blocks::log };
+
+	world::chunk a, b, c;
+	a.fill(world::blocks::air);
+	b.fill(world::blocks::air);
+	c.fill(world::blocks::air);
+
+	// b sees glass first, so its palette is ordered differently, and
+	// both b and c keep a glass palette entry that is no longer used
+	a.set(9, 9, 9, world::blocks::dirt);
+	b.set(9, 9, 9, test::blocks::glass);
+	c.set(9, 9, 9, test::blocks::glass);
+
+	std::mt19937 rng(16);
+	for (int i = 0; i < 3000; i++) {
+		int x = rng() % CHUNK_TOTAL, y = rng() % CHUNK_TOTAL,
+		    z = rng() % CHUNK_TOTAL;
+		world::block_id block = solids[rng() % 2];
+
+		a.set(x, y, z, block);
+		b.set(x, y, z, block);
+		c.set(x, y, z, block);
+	}
+
+	b.set(9, 9, 9, a.get(9, 9, 9));
+	c.set(9, 9, 9, a.get(9, 9, 9));
+
+	std::vector<uint8_t> ea, eb, ec;
+	a.encode_content(ea);
+	b.encode_content(eb);
+	c.encode_content(ec);
+
+	REQUIRE(a.get_storage().palette() != b.get_storage().palette());
+	REQUIRE(ea == eb);
+	REQUIRE(ea == ec);
+	REQUIRE(a.content_hash() == b.content_hash());
+
+	// One block apart, in the halo
+	c.set(0, 5, 5, a.get(0, 5, 5) == world::blocks::air ?
+			       world::blocks::dirt :
+			       world::blocks::air);
+	ec.clear();
+	c.encode_content(ec);
+	REQUIRE(ea != ec);
+
+	// Uniform chunks encode like any other chunk of the same blocks
+	world::chunk uniform, grown;
+	uniform.fill(world::blocks::dirt);
+	grown.fill(world::blocks::dirt);
+	grown.set(5, 5, 5, world::blocks::air);
+	grown.set(5, 5, 5, world::blocks::dirt);
+	REQUIRE(uniform.is_uniform());
+	REQUIRE_FALSE(grown.is_uniform());
+
+	std::vector<uint8_t> eu, eg;
+	uniform.encode_content(eu);
+	grown.encode_content(eg);
+	REQUIRE(eu == eg);
+}
+
+TEST_CASE("only chunks with equal blocks share a mesh", "[meshing]")
+{
+	world::world_state state;
+
+	// Far enough apart that no chunk sees another in its halo
+	const glm::ivec3 coords[] = { { 0, 0, 0 },
+				      { 3, 0, 0 },
+				      { 6, 0, 0 },
+				      { 9, 0, 0 } };
+	for (const glm::ivec3 &c : coords) {
+		state.load_chunk(c, world::blocks::air);
+	}
+
+	std::mt19937 rng(17);
+	for (int i = 0; i < 500; i++) {
+		glm::ivec3 pos(rng() % CHUNK_SIZE, rng() % CHUNK_SIZE,
+			       rng() % CHUNK_SIZE);
+		for (const glm::ivec3 &c : coords) {
+			state.set_block(c * CHUNK_SIZE + pos,
+					world::blocks::dirt);
+		}
+	}
+
+	// The third chunk differs by one block, the fourth only in history
+	glm::ivec3 extra(3, 3, 3);
+	if (state.get_block(extra) == world::blocks::dirt) {
+		extra = glm::ivec3(3, 3, 4);
+	}
+
+	state.set_block(coords[2] * CHUNK_SIZE + extra, world::blocks::dirt);
+	state.set_block(coords[3] * CHUNK_SIZE + extra, test::blocks::log);
+	state.set_block(coords[3] * CHUNK_SIZE + extra, world::blocks::air);
+
+	tf::Executor executor(1);
+	world::meshing_service service(
+		&executor,
+		std::make_unique<world::greedy_chunk_draw_data_generator>());
+
+	auto snapshot = state.snapshot();
+	for (const glm::ivec3 &c : coords) {
+		service.request(snapshot, c);
+	}
+
+	flush(executor);
+
+	std::vector<world::meshing_service::result> results;
+	REQUIRE(service.collect(results, 10) == 4);
+
+	std::shared_ptr<const world::chunk_mesh> meshes[4];
+	uint64_t hashes[4];
+	for (const auto &res : results) {
+		for (int i = 0; i < 4; i++) {
+			if (res.coords == coords[i]) {
+				meshes[i] = res.mesh;
+				hashes[i] = res.hash;
+			}
+		}
+	}
+
+	REQUIRE(meshes[0] == meshes[1]);
+	REQUIRE(meshes[0] == meshes[3]);
+	REQUIRE(hashes[0] == hashes[1]);
+	REQUIRE(hashes[0] == hashes[3]);
+	REQUIRE_FALSE(meshes[0]->content.empty());
+
+	REQUIRE(meshes[2] != meshes[0]);
+	REQUIRE(hashes[2] != hashes[0]);
+	REQUIRE(meshes[2]->content != meshes[0]->content);
+}
@@ -0,0 +1,117 @@
+#include "meshes.h"
+
+#include <catch2/catch_template_test_macros.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+
+#include <memory>
+#include <random>
+#include <type_traits>
+
+using namespace mc;
+
+// Checks the opacity columns and queries of ch against its blocks
+template <uint32_t size_log>
+static void check_occupancy(const world::basic_chunk<size_log> &ch)
+{
+	using dims = world::chunk_dims<size_log>;
+
+	const world::block_properties *props = world::blocks::get_properties();
+	auto opaque = [&](int x, int y, int z) {
+		return props->is_opaque(ch.get(x, y, z));
+	};
+
+	for (int x = 0; x < dims::total; x++) {
+		for (int y = 0; y < dims::total; y++) {
+			for (int z = 0; z < dims::total; z++) {
+				REQUIRE(ch.is_opaque(x, y, z) ==
+					opaque(x, y, z));
+			}
+		}
+	}
+
+	const auto *occ = ch.get_occupancy();
+	if (occ == nullptr) {
+		return;
+	}
+
+	for (int a = 0; a < dims::total; a++) {
+		for (int b = 0; b < dims::total; b++) {
+			uint64_t x = 0, y = 0, z = 0;
+			for (int i = 0; i < dims::size; i++) {
+				int c = dims::begin + i;
+				uint64_t bit = 1ull << i;
+				x |= opaque(c, a, b) ? bit : 0;
+				y |= opaque(a, c, b) ? bit : 0;
+				z |= opaque(a, b, c) ? bit : 0;
+			}
+
+			CAPTURE(a, b);
+			REQUIRE(occ->column_x(a, b) == x);
+			REQUIRE(occ->column_y(a, b) == y);
+			REQUIRE(occ->column_z(a, b) == z);
+
+			REQUIRE(occ->column(0, a, b) == x);
+			REQUIRE(occ->column(1, a, b) == y);
+			REQUIRE(occ->column(2, a, b) == z);
+		}
+	}
+}
+
+TEMPLATE_TEST_CASE("occupancy columns follow the blocks", "[occupancy]",
+		   (std::integral_constant<uint32_t, 4>),
+		   (std::integral_constant<uint32_t, 5>),
+		   (std::integral_constant<uint32_t, 6>))
+{
+	constexpr uint32_t size_log = TestType::value;
+	using dims = world::chunk_dims<size_log>;
+
+	auto pattern = GENERATE(test::chunk_pattern::random,
+				test::chunk_pattern::terrain,
+				test::chunk_pattern::halo_edges);
+
+	auto ch = std::make_unique<world::basic_chunk<size_log> >();
+	test::fill_chunk<size_log>(*ch, pattern, 1);
+	check_occupancy(*ch);
+
+	// Edits update the columns in place, corners included
+	const world::block_id edits[] = { world::blocks::air,
+					  world::blocks::dirt,
+					  test::blocks::glass };
+
+	std::mt19937 rng(3);
+	for (int e = 0; e < 200; e++) {
+		int x = rng() % dims::total;
+		int y = rng() % dims::total;
+		int z = rng() % dims::total;
+		ch->set(x, y, z, edits[rng() % 3]);
+	}
+
+	check_occupancy(*ch);
+}
+
+TEMPLATE_TEST_CASE("uniform chunks have no occupancy columns", "[occupancy]",
+		   (std::integral_constant<uint32_t, 4>),
+		   (std::integral_constant<uint32_t, 5>),
+		   (std::integral_constant<uint32_t, 6>))
+{
+	constexpr uint32_t size_log = TestType::value;
+
+	const world::block_id fills[] = { world::blocks::air,
+					  world::blocks::dirt,
+					  test::blocks::glass };
+	world::block_id block = fills[GENERATE(0, 1, 2)];
+
+	world::basic_chunk<size_log> ch(block);
+	REQUIRE(ch.get_occupancy() == nullptr);
+	check_occupancy(ch);
+
+	// The first block of another opacity brings the columns in
+	world::block_id other = block == world::blocks::dirt ?
+					world::blocks::air :
+					world::blocks::dirt;
+	ch.set(3, 4, 5, other);
+
+	REQUIRE(ch.get_occupancy() != nullptr);
+	check_occupancy(ch);
+}
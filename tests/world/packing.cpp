@@ -0,0 +1,297 @@
+#include "meshes.h"
+
+#include <catch2/catch_template_test_macros.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+using namespace mc;
+
+template <uint32_t size_log>
+static world::face_draw_data random_face(std::mt19937 &rng,
+					 world::block_face normal)
+{
+	using dims = world::chunk_dims<size_log>;
+
+	world::face_draw_data face;
+	face.face = rng();
+	face.normal = normal;
+	face.ao = rng();
+	face.x = dims::begin + rng() % dims::size;
+	face.y = dims::begin + rng() % dims::size;
+	face.z = dims::begin + rng() % dims::size;
+	face.w = 1 + rng() % dims::size;
+	face.h = 1 + rng() % dims::size;
+	return face;
+}
+
+static void check_face(const world::face_draw_data &a,
+		       const world::face_draw_data &b)
+{
+	REQUIRE(a.face == b.face);
+	REQUIRE(a.ao == b.ao);
+	REQUIRE(a.x == b.x);
+	REQUIRE(a.y == b.y);
+	REQUIRE(a.z == b.z);
+	REQUIRE(a.w == b.w);
+	REQUIRE(a.h == b.h);
+}
+
+TEMPLATE_TEST_CASE("packed faces unpack to the same face", "[packing]",
+		   (std::integral_constant<uint32_t, 4>),
+		   (std::integral_constant<uint32_t, 5>),
+		   (std::integral_constant<uint32_t, 6>))
+{
+	constexpr uint32_t size_log = TestType::value;
+	using dims = world::chunk_dims<size_log>;
+
+	std::mt19937 rng(15);
+	for (int i = 0; i < 10000; i++) {
+		world::face_draw_data face =
+			random_face<size_log>(rng, world::block_face::up);
+		check_face(world::unpack_face<size_log>(
+				   world::pack_face<size_log>(face)),
+			   face);
+	}
+
+	// Every field at its largest, so none spills into the next
+	world::face_draw_data last;
+	last.face = 0xffff;
+	last.normal = world::block_face::south;
+	last.ao = 0xff;
+	last.x = last.y = last.z = dims::end - 1;
+	last.w = last.h = dims::size;
+
+	world::face_draw_data first;
+	first.face = 0;
+	first.normal = world::block_face::east;
+	first.ao = 0;
+	first.x = first.y = first.z = dims::begin;
+
+	check_face(world::unpack_face<size_log>(
+			   world::pack_face<size_log>(last)),
+		   last);
+	check_face(world::unpack_face<size_log>(
+			   world::pack_face<size_log>(first)),
+		   first);
+
+	world::packed_face zero = world::pack_face<size_log>(first);
+	REQUIRE(zero.geometry == 0);
+	REQUIRE(zero.shading == 0);
+}
+
+TEMPLATE_TEST_CASE("face sinks keep each normal contiguous", "[packing]",
+		   (std::integral_constant<uint32_t, 4>),
+		   (std::integral_constant<uint32_t, 5>),
+		   (std::integral_constant<uint32_t, 6>))
+{
+	constexpr uint32_t size_log = TestType::value;
+
+	// Bit n set if normal n gets faces, including none and all of them
+	uint32_t present = GENERATE(0u, 0x3fu, 0x01u, 0x20u, 0x15u, 0x2au,
+				    0x1eu);
+
+	std::mt19937 rng(present);
+	std::vector<world::packed_face> buffer(200 * 6);
+	world::basic_face_sink<size_log> sink(buffer.data());
+
+	std::vector<world::face_draw_data> pushed;
+	uint32_t counts[6] = {};
+	for (int n = 0; n < 6; n++) {
+		if ((present >> n & 1) == 0) {
+			continue;
+		}
+
+		counts[n] = 1 + rng() % 200;
+		for (uint32_t i = 0; i < counts[n]; i++) {
+			pushed.push_back(random_face<size_log>(
+				rng, static_cast<world::block_face>(n)));
+			sink.push(pushed.back());
+		}
+	}
+
+	REQUIRE(sink.size() == pushed.size());
+	REQUIRE(sink.data() == buffer.data());
+
+	uint32_t offset = 0;
+	for (int n = 0; n < 6; n++) {
+		auto normal = static_cast<world::block_face>(n);
+
+		CAPTURE(n);
+		REQUIRE(sink.get_offset(normal) == offset);
+		REQUIRE(sink.get_count(normal) == counts[n]);
+
+		for (uint32_t i = offset; i < offset + counts[n]; i++) {
+			check_face(world::unpack_face<size_log>(buffer[i]),
+				   pushed[i]);
+		}
+
+		offset += counts[n];
+	}
+}
+
+TEMPLATE_TEST_CASE("meshers fill sinks in normal order", "[packing]",
+		   (std::integral_constant<uint32_t, 4>),
+		   (std::integral_constant<uint32_t, 5>),
+		   (std::integral_constant<uint32_t, 6>))
+{
+	constexpr uint32_t size_log = TestType::value;
+	using dims = world::chunk_dims<size_log>;
+
+	auto pattern = GENERATE(test::chunk_pattern::random,
+				test::chunk_pattern::terrain,
+				test::chunk_pattern::halo_edges);
+
+	auto ch = std::make_unique<world::basic_chunk<size_log> >();
+	test::fill_chunk<size_log>(*ch, pattern, 3);
+
+	world::basic_simple_chunk_draw_data_generator<size_log> simple;
+	world::basic_greedy_chunk_draw_data_generator<size_log> greedy;
+	const world::basic_chunk_draw_data_generator<size_log> *generators[] = {
+		&simple, &greedy
+	};
+
+	for (const auto *gen : generators) {
+		// The draw data of the same generator, in the same order
+		std::vector<world::face_draw_data> faces =
+			gen->generate(ch.get()).faces;
+
+		std::vector<world::packed_face> buffer(dims::max_faces);
+		world::basic_face_sink<size_log> sink(buffer.data());
+		gen->generate(ch.get(), sink);
+
+		REQUIRE(sink.size() == faces.size());
+
+		uint32_t total = 0;
+		for (int n = 0; n < 6; n++) {
+			auto normal = static_cast<world::block_face>(n);
+			uint32_t offset = sink.get_offset(normal);
+			uint32_t count = sink.get_count(normal);
+
+			for (uint32_t i = offset; i < offset + count; i++) {
+				REQUIRE(faces[i].normal == normal);
+				check_face(world::unpack_face<size_log>(
+						   buffer[i]),
+					   faces[i]);
+			}
+
+			total += count;
+		}
+
+		REQUIRE(total == sink.size());
+	}
+}
+
+// Decodes the output of compact_faces() and checks it against the faces it
+// was made from
+template <uint32_t size_log>
+static void check_compact(const std::vector<world::packed_face> &faces,
+			  const std::vector<uint32_t> &compact,
+			  const world::face_id *textures, uint32_t size)
+{
+	const uint32_t shift = 3 * size_log + 8;
+
+	for (size_t i = 0; i < faces.size(); i++) {
+		uint32_t index = compact[i] >> shift;
+		REQUIRE(index < size);
+
+		REQUIRE((compact[i] & ((1u << shift) - 1)) ==
+			faces[i].geometry);
+		REQUIRE(textures[index] == faces[i].shading);
+	}
+}
+
+TEMPLATE_TEST_CASE("compact faces keep geometry and texture", "[packing]",
+		   (std::integral_constant<uint32_t, 4>),
+		   (std::integral_constant<uint32_t, 5>),
+		   (std::integral_constant<uint32_t, 6>))
+{
+	constexpr uint32_t size_log = TestType::value;
+
+	// Up to the most textures the format has room for
+	uint32_t distinct = GENERATE(1u, 2u, 17u, 64u);
+
+	std::mt19937 rng(distinct);
+	std::vector<world::packed_face> faces;
+	for (uint32_t i = 0; i < 3000; i++) {
+		world::face_draw_data face = random_face<size_log>(
+			rng, static_cast<world::block_face>(i % 6));
+		face.face = 1000 + (i < distinct ? i : rng() % distinct);
+		face.w = face.h = 1;
+		faces.push_back(world::pack_face<size_log>(face));
+	}
+
+	std::vector<uint32_t> compact(faces.size());
+	world::face_id textures[COMPACT_TEXTURES];
+	uint32_t size = world::compact_faces<size_log>(
+		faces.data(), faces.size(), compact.data(), textures);
+	REQUIRE(size == distinct);
+
+	// Each texture once
+	std::vector<world::face_id> table(textures, textures + size);
+	std::sort(table.begin(), table.end());
+	REQUIRE(std::unique(table.begin(), table.end()) == table.end());
+
+	check_compact<size_log>(faces, compact, textures, size);
+}
+
+TEMPLATE_TEST_CASE("faces that do not fit stay wide", "[packing]",
+		   (std::integral_constant<uint32_t, 4>),
+		   (std::integral_constant<uint32_t, 5>),
+		   (std::integral_constant<uint32_t, 6>))
+{
+	constexpr uint32_t size_log = TestType::value;
+
+	std::mt19937 rng(21);
+	std::vector<world::face_draw_data> unit;
+	for (int i = 0; i < 500; i++) {
+		unit.push_back(
+			random_face<size_log>(rng, world::block_face::up));
+		unit.back().face = i % 8;
+		unit.back().w = unit.back().h = 1;
+	}
+
+	auto compact = [](const std::vector<world::face_draw_data> &in) {
+		std::vector<world::packed_face> faces;
+		for (const world::face_draw_data &f : in) {
+			faces.push_back(world::pack_face<size_log>(f));
+		}
+
+		std::vector<uint32_t> words(faces.size());
+		world::face_id textures[COMPACT_TEXTURES];
+		return world::compact_faces<size_log>(
+			faces.data(), faces.size(), words.data(), textures);
+	};
+
+	REQUIRE(compact(unit) == 8);
+
+	// A single merged quad, along either axis, anywhere in the mesh
+	for (size_t at : { size_t(0), size_t(250), unit.size() - 1 }) {
+		std::vector<world::face_draw_data> merged = unit;
+		merged[at].w = 2;
+		REQUIRE(compact(merged) == 0);
+
+		merged[at].w = 1;
+		merged[at].h = world::chunk_dims<size_log>::size;
+		REQUIRE(compact(merged) == 0);
+	}
+
+	// One texture more than the table holds, then exactly as many
+	std::vector<world::face_draw_data> many = unit;
+	for (size_t i = 0; i < many.size(); i++) {
+		many[i].face = 100 + i % (COMPACT_TEXTURES + 1);
+	}
+
+	REQUIRE(compact(many) == 0);
+
+	for (size_t i = 0; i < many.size(); i++) {
+		many[i].face = 100 + i % COMPACT_TEXTURES;
+	}
+
+	REQUIRE(compact(many) == COMPACT_TEXTURES);
+}
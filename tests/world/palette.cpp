@@ -0,0 +1,143 @@
+#include "mineclonelib/world/palette.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+
+#include <random>
+#include <vector>
+
+using namespace mc;
+
+static void check_contents(const world::palette_storage &storage,
+			   const std::vector<world::block_id> &expected)
+{
+	for (uint32_t i = 0; i < expected.size(); i++) {
+		REQUIRE(storage.get(i) == expected[i]);
+	}
+
+	std::vector<world::block_id> dense(expected.size());
+	storage.unpack(dense.data());
+	REQUIRE(dense == expected);
+}
+
+TEST_CASE("palette storage starts uniform", "[palette]")
+{
+	world::palette_storage storage(1000, 7);
+
+	REQUIRE(storage.is_uniform());
+	REQUIRE(storage.bits() == 0);
+	check_contents(storage, std::vector<world::block_id>(1000, 7));
+}
+
+TEST_CASE("palette storage widens its indices on demand", "[palette]")
+{
+	// Odd sized, so the last word is partly used
+	const uint32_t size = 4099;
+
+	world::palette_storage storage(size);
+	std::vector<world::block_id> expected(size, 0);
+
+	// Palette sizes at which the indices need the next width
+	const struct {
+		uint32_t distinct;
+		uint32_t bits;
+	} steps[] = { { 2, 1 }, { 3, 2 }, { 5, 4 }, { 17, 8 }, { 257, 16 } };
+
+	std::mt19937 rng(1);
+	world::block_id next = 1;
+	for (const auto &step : steps) {
+		for (; next < step.distinct; next++) {
+			uint32_t idx = rng() % size;
+			storage.set(idx, next);
+			expected[idx] = next;
+		}
+
+		CAPTURE(step.distinct);
+		REQUIRE(storage.bits() == step.bits);
+		REQUIRE(storage.palette().size() == step.distinct);
+		check_contents(storage, expected);
+	}
+
+	// Rewrites at the widest size keep every other index intact
+	for (int i = 0; i < 10000; i++) {
+		uint32_t idx = rng() % size;
+		world::block_id block = rng() % next;
+		storage.set(idx, block);
+		expected[idx] = block;
+	}
+
+	REQUIRE(storage.bits() == 16);
+	check_contents(storage, expected);
+}
+
+TEST_CASE("compacting a palette narrows its indices", "[palette]")
+{
+	const uint32_t size = 4096;
+
+	world::palette_storage storage(size);
+	std::vector<world::block_id> expected(size, 0);
+
+	std::mt19937 rng(2);
+	for (uint32_t i = 0; i < size; i++) {
+		world::block_id block = rng() % 40;
+		storage.set(i, block);
+		expected[i] = block;
+	}
+
+	REQUIRE(storage.bits() == 8);
+
+	SECTION("down to a few blocks")
+	{
+		for (uint32_t i = 0; i < size; i++) {
+			world::block_id block = i % 3 == 0 ? 5 : 9;
+			storage.set(i, block);
+			expected[i] = block;
+		}
+
+		storage.compact();
+
+		REQUIRE(storage.bits() == 1);
+		REQUIRE(storage.palette().size() == 2);
+		check_contents(storage, expected);
+
+		// Still writable after the palette was rebuilt
+		storage.set(17, 33);
+		expected[17] = 33;
+		REQUIRE(storage.bits() == 2);
+		check_contents(storage, expected);
+	}
+
+	SECTION("down to one block")
+	{
+		for (uint32_t i = 0; i < size; i++) {
+			storage.set(i, 3);
+		}
+
+		storage.compact();
+
+		REQUIRE(storage.is_uniform());
+		check_contents(storage, std::vector<world::block_id>(size, 3));
+	}
+
+	SECTION("with every entry in use")
+	{
+		storage.compact();
+
+		REQUIRE(storage.bits() == 8);
+		check_contents(storage, expected);
+	}
+}
+
+TEST_CASE("filling a palette storage makes it uniform", "[palette]")
+{
+	world::palette_storage storage(512);
+	for (uint32_t i = 0; i < 512; i++) {
+		storage.set(i, i % 20);
+	}
+
+	storage.fill(4);
+
+	REQUIRE(storage.is_uniform());
+	REQUIRE(storage.palette().size() == 1);
+	check_contents(storage, std::vector<world::block_id>(512, 4));
+}
@@ -0,0 +1,98 @@
+#include "meshes.h"
+
+#include <catch2/catch_template_test_macros.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+using namespace mc;
+
+// A coordinate biased towards the halo and the interior boundary, where
+// patches reach into neighbouring rows and the halo
+template <uint32_t size_log> static int edit_coord(std::mt19937 &rng)
+{
+	using dims = world::chunk_dims<size_log>;
+
+	switch (rng() % 4) {
+	case 0:
+		return rng() % 2 == 0 ? 0 : dims::total - 1;
+	case 1:
+		return rng() % 2 == 0 ? dims::begin : dims::end - 1;
+	default:
+		return rng() % dims::total;
+	}
+}
+
+static bool same_face(const world::packed_face &a,
+		      const world::packed_face &b) noexcept
+{
+	return a.geometry == b.geometry && a.shading == b.shading;
+}
+
+TEMPLATE_TEST_CASE("patched meshes match a full remesh", "[meshing]",
+		   (std::integral_constant<uint32_t, 4>),
+		   (std::integral_constant<uint32_t, 5>),
+		   (std::integral_constant<uint32_t, 6>))
+{
+	constexpr uint32_t size_log = TestType::value;
+
+	auto pattern = GENERATE(test::chunk_pattern::random,
+				test::chunk_pattern::terrain,
+				test::chunk_pattern::checkerboard,
+				test::chunk_pattern::halo_edges);
+
+	auto ch = std::make_unique<world::basic_chunk<size_log> >();
+	test::fill_chunk<size_log>(*ch, pattern, 1);
+
+	world::basic_greedy_chunk_draw_data_generator<size_log> greedy;
+	world::chunk_mesh mesh = test::build_mesh<size_log>(greedy, ch.get());
+
+	const world::block_id edits[] = { world::blocks::air,
+					  world::blocks::dirt,
+					  test::blocks::log,
+					  test::blocks::glass };
+
+	std::mt19937 rng(static_cast<uint32_t>(pattern) + 1);
+	for (int e = 0; e < 32; e++) {
+		int x = edit_coord<size_log>(rng);
+		int y = edit_coord<size_log>(rng);
+		int z = edit_coord<size_log>(rng);
+		world::block_id block = edits[rng() % 4];
+
+		CAPTURE(e, x, y, z, block);
+
+		uint32_t before[6];
+		std::copy(mesh.counts, mesh.counts + 6, before);
+		std::vector<world::packed_face> old_faces = mesh.faces;
+
+		ch->set(x, y, z, block);
+		uint8_t changed =
+			world::patch_mesh<size_log>(ch.get(), x, y, z, mesh);
+
+		REQUIRE(test::expand<size_log>(mesh) ==
+			test::expand<size_log>(
+				test::build_mesh<size_log>(greedy, ch.get())));
+
+		// Normals left out of the mask keep their faces as they were
+		uint32_t old_offset = 0, offset = 0;
+		for (int k = 0; k < 6; k++) {
+			if ((changed & (1 << k)) == 0) {
+				REQUIRE(mesh.counts[k] == before[k]);
+				REQUIRE(std::equal(
+					old_faces.begin() + old_offset,
+					old_faces.begin() + old_offset +
+						before[k],
+					mesh.faces.begin() + offset,
+					same_face));
+			}
+
+			old_offset += before[k];
+			offset += mesh.counts[k];
+		}
+	}
+}
@@ -0,0 +1,155 @@
+#include "mineclonelib/world/world.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <map>
+#include <random>
+#include <vector>
+
+using namespace mc;
+
+using dims = world::chunk_dims<CHUNK_SIZE_LOG>;
+
+// Padded contents of every chunk a snapshot holds, halos included
+using contents = std::map<uint64_t, std::vector<world::block_id> >;
+
+static contents capture(const world::world_snapshot &snap)
+{
+	contents result;
+	snap.for_each_chunk([&](const glm::ivec3 &coords,
+				const world::chunk *ch) {
+		std::vector<world::block_id> &dense =
+			result[world::pack_coords(coords)];
+		dense.resize(dims::total * dims::total * dims::total);
+		ch->unpack(dense.data());
+	});
+
+	return result;
+}
+
+static void load_cube(world::world_state &state, int n)
+{
+	for (int x = 0; x < n; x++) {
+		for (int y = 0; y < n; y++) {
+			for (int z = 0; z < n; z++) {
+				state.load_chunk({ x, y, z });
+			}
+		}
+	}
+}
+
+// Edits n random blocks of an n chunk wide cube, half on chunk borders
+static void edit(world::world_state &state, std::mt19937 &rng, int chunks,
+		 int n)
+{
+	for (int e = 0; e < n; e++) {
+		glm::ivec3 pos(rng() % (chunks * CHUNK_SIZE),
+			       rng() % (chunks * CHUNK_SIZE),
+			       rng() % (chunks * CHUNK_SIZE));
+		if (e % 2 == 0) {
+			pos.x = pos.x / CHUNK_SIZE * CHUNK_SIZE;
+		}
+
+		state.set_block(pos, rng() % 2 == 0 ? world::blocks::dirt :
+						      world::blocks::air);
+	}
+}
+
+TEST_CASE("snapshots never see later writes", "[snapshot]")
+{
+	world::world_state state;
+	load_cube(state, 2);
+
+	std::mt19937 rng(10);
+	edit(state, rng, 2, 500);
+
+	std::shared_ptr<world::world_snapshot> snap = state.snapshot();
+	contents before = capture(*snap);
+	REQUIRE(before.size() == 8);
+
+	// Writes go to copies, halos of neighbours included
+	edit(state, rng, 2, 2000);
+	state.load_chunk({ 2, 0, 0 }, world::blocks::dirt);
+	state.unload_chunk({ 1, 1, 1 });
+
+	REQUIRE(capture(*snap) == before);
+	REQUIRE(snap->size() == 8);
+	REQUIRE(snap->get_chunk({ 2, 0, 0 }) == nullptr);
+	REQUIRE(snap->get_chunk({ 1, 1, 1 }) != nullptr);
+
+	// The live world sees every write
+	glm::ivec3 pos(CHUNK_SIZE, 3, 5);
+	state.set_block(pos, world::blocks::dirt);
+	REQUIRE(state.get_block(pos) == world::blocks::dirt);
+	REQUIRE(state.get_chunk({ 1, 1, 1 }) == nullptr);
+
+	world::block_id old =
+		before[world::pack_coords({ 1, 0, 0 })]
+		      [(dims::begin * dims::total + dims::begin + 3) *
+			       dims::total +
+		       dims::begin + 5];
+	REQUIRE(snap->get_block(pos) == old);
+
+	// A later snapshot sees the writes, and the first one still does not
+	std::shared_ptr<world::world_snapshot> later = state.snapshot();
+	REQUIRE(later->get_block(pos) == world::blocks::dirt);
+	REQUIRE(capture(*snap) == before);
+
+	later.reset();
+	snap.reset();
+	state.reclaim();
+}
+
+TEST_CASE("old chunk versions are freed once no snapshot sees them",
+	  "[snapshot]")
+{
+	world::world_state state;
+	load_cube(state, 2);
+
+	std::mt19937 rng(11);
+
+	// Without snapshots chunks are written in place
+	const world::chunk *ch = state.get_chunk({ 0, 0, 0 });
+	edit(state, rng, 2, 200);
+	REQUIRE(state.get_retired() == 0);
+	REQUIRE(state.get_chunk({ 0, 0, 0 }) == ch);
+
+	std::shared_ptr<world::world_snapshot> first = state.snapshot();
+	edit(state, rng, 2, 200);
+
+	// Every chunk was written, and is copied once per epoch
+	size_t retired_first = state.get_retired();
+	REQUIRE(retired_first == 8);
+
+	edit(state, rng, 2, 200);
+	REQUIRE(state.get_retired() == retired_first);
+
+	std::shared_ptr<world::world_snapshot> second = state.snapshot();
+	contents seen = capture(*second);
+	edit(state, rng, 2, 200);
+	size_t retired_both = state.get_retired();
+	REQUIRE(retired_both > retired_first);
+
+	state.reclaim();
+	REQUIRE(state.get_retired() == retired_both);
+
+	// Versions replaced after the second snapshot are still visible to it
+	first.reset();
+	state.reclaim();
+	REQUIRE(state.get_retired() == retired_both - retired_first);
+	REQUIRE(capture(*second) == seen);
+
+	second.reset();
+	state.reclaim();
+	REQUIRE(state.get_retired() == 0);
+
+	// Unloaded chunks stay around for the snapshots holding them
+	std::shared_ptr<world::world_snapshot> third = state.snapshot();
+	state.unload_chunk({ 1, 0, 0 });
+	REQUIRE(state.get_retired() == 1);
+	REQUIRE(third->get_chunk({ 1, 0, 0 }) != nullptr);
+
+	third.reset();
+	state.reclaim();
+	REQUIRE(state.get_retired() == 0);
+}